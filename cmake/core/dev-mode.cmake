@@ -12,6 +12,9 @@ if(BUILD_TESTING)
   add_subdirectory(src/tests)
 endif()
 
+add_subdirectory(src/nlog-decode)
+add_subdirectory(src/nlog-decompress)
+
 # Note: PROJECT_SOURCE_DIR is always the root directory of the project 
 #       being configured. 
 
@@ -19,7 +22,9 @@ endif()
 file(GLOB_RECURSE headers CONFIGURE_DEPENDS "${PROJECT_SOURCE_DIR}/include/${PROJECT_NAME}/*.hpp")
 source_group(TREE "${PROJECT_SOURCE_DIR}/include" PREFIX headers FILES ${headers})
 
-file(GLOB_RECURSE sources CONFIGURE_DEPENDS "${PROJECT_SOURCE_DIR}/src/tests/*.cpp")
+file(GLOB_RECURSE sources CONFIGURE_DEPENDS "${PROJECT_SOURCE_DIR}/src/tests/*.cpp"
+                                            "${PROJECT_SOURCE_DIR}/src/nlog-decode/*.cpp"
+                                            "${PROJECT_SOURCE_DIR}/src/nlog-decompress/*.cpp")
 file(GLOB_RECURSE includes CONFIGURE_DEPENDS "${PROJECT_SOURCE_DIR}/src/tests/*.hpp")
 source_group(TREE "${PROJECT_SOURCE_DIR}/src" PREFIX sources FILES ${sources} ${includes})
 
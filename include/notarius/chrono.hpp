@@ -117,7 +117,8 @@ namespace slx
       inline std::string date_time_to_string(const std::string_view fmt = "%Y-%m-%d %H:%M:%S")
       {
          const auto now = std::chrono::system_clock::now();
-         auto ms = static_cast<int>(now.time_since_epoch().count() % 1000);
+         const auto ms = static_cast<int>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000);
 
          std::time_t t = std::chrono::system_clock::to_time_t(now);
          std::tm tm{};
@@ -128,7 +129,7 @@ namespace slx
 #endif
          char buffer[24]{};
          std::strftime(buffer, sizeof(buffer), fmt.data(), &tm);
-         return std::string(buffer) + "." + std::to_string(ms);
+         return std::format("{}.{:03}", buffer, ms);
       }
 
       struct duration_t
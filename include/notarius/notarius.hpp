@@ -6,12 +6,19 @@ module notarius;
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <barrier>
+#include <bit>
 #include <cassert>
 #include <charconv>
+#include <chrono>
 #include <compare>
 #include <condition_variable>
 #include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
 #include <deque>
 #include <filesystem>
 #include <format>
@@ -19,19 +26,54 @@ module notarius;
 #include <functional>
 #include <future>
 #include <iostream>
+#include <iterator>
+#include <memory>
 #include <mutex>
+#include <new>
 #include <optional>
 #include <queue>
 #include <shared_mutex>
+#include <span>
+#include <stdexcept>
 #include <stop_token>
 #include <streambuf>
 #include <string>
 #include <string_view>
 #include <system_error>
 #include <thread>
+#include <tuple>
 #include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <variant>
 #include <vector>
 
+#if defined(_MSC_VER)
+#include <intrin.h> // __rdtsc
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#define NOTARIUS_HAS_MMAP
+#define NOTARIUS_HAS_WRITEV
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#if defined(O_DIRECT)
+#define NOTARIUS_HAS_O_DIRECT
+#endif
+#if defined(FALLOC_FL_KEEP_SIZE)
+#define NOTARIUS_HAS_FALLOCATE
+#endif
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define NOTARIUS_HAS_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
 #if defined(USE_STD_PRINT)
 #if defined(_MSC_VER)
 #define CPP_VERSION _MSVC_LANG
@@ -426,12 +468,68 @@ namespace slx
       return log_strings[int(level)];
    }
 
+   // clang-format off
+   /**
+    * @brief What happens to a message logged while the async queue is full.
+    */
+   enum class overflow_policy : int {
+       block,            ///< The producer waits until the writer thread has made room.
+       drop_newest,      ///< The new message is dropped.
+       drop_oldest,      ///< The oldest queued messages are dropped to make room.
+       drop_below_level  ///< Messages below 'async_overflow_level' are dropped, others wait.
+   };
+   // clang-format on
+
+   /**
+    * @brief A log pattern (see: 'notarius_opts_t::pattern'), held by value so that it can be
+    *        part of the 'notarius_opts_t' template argument.
+    */
+   struct log_pattern_t final
+   {
+      static constexpr size_t max_size = 128;
+
+      std::array<char, max_size> value{};
+      size_t size{};
+
+      constexpr log_pattern_t() noexcept = default;
+
+      template <size_t N>
+      consteval log_pattern_t(const char (&str)[N]) noexcept : size(N - 1)
+      {
+         static_assert(N - 1 <= max_size, "the log pattern is too long");
+         std::copy_n(str, N - 1, value.data());
+      }
+
+      constexpr std::string_view sv() const noexcept { return {value.data(), size}; }
+   };
+
+   // clang-format off
+   /**
+    * @brief The clock used to timestamp messages (see: 'notarius_opts_t::enable_timestamps').
+    */
+   enum class clock_source : int {
+       system,           ///< std::chrono::system_clock.
+       steady,           ///< std::chrono::steady_clock, offset to the wall time when first used.
+       realtime_coarse,  ///< clock_gettime(CLOCK_REALTIME_COARSE) on Linux, otherwise 'system'.
+       tsc               ///< The CPU's time stamp counter, calibrated against std::chrono::system_clock.
+   };
+   // clang-format on
+
    /// @brief Defines default configuration options for the notarius logging system.
    struct notarius_opts_t
    {
       bool enable_file_logging{false}; ///< Enable logging to file.
 
-      bool lock_free_enabled{false}; ///< Flag to enable lock-free logging.
+      /**
+       * @brief Append to the logging store without taking the logger's mutex.
+       *
+       * Messages are copied into a preallocated segment (see: 'lock_free_segment_bytes')
+       * after reserving space with an atomic fetch-add. A full segment is handed
+       * to the flusher and replaced without blocking other producers. Writing
+       * to the standard outputs still takes the mutex, so disable them for
+       * the best results.
+       */
+      bool lock_free_enabled{false};
 
       /**
        * @brief If immediate_mode is true, all data is written directly
@@ -502,6 +600,9 @@ namespace slx
        *
        * When the log buffer reaches this size, it will be flushed to the
        * respective standard output streams (stdout, stderr, or stdlog).
+       * On POSIX, unless a stream has been redirected, 'flush' writes what is
+       * pending with a single writev(2) per file descriptor (stderr and stdlog
+       * share one).
        */
       size_t flush_to_std_outputs_at_bytes{1024};
 
@@ -520,253 +621,4197 @@ namespace slx
        * @brief Flush to the log file when this size is exceeded.
        *
        * When the log buffer reaches this size, it will be flushed to the log file.
+       * The full buffer is swapped with a second one and written after the logger's
+       * lock has been released, so other threads keep logging during the write.
        *
        * 'enable_file_logging' must be true
        *
        */
       size_t flush_to_log_at_bytes{1'048'576 * 16}; // 16 MB
-   };
 
-   struct output_as_json_t
-   {
-      std::unordered_map<std::string, std::vector<std::string>> data;
-   };
+      /**
+       * @brief Hand messages to a background writer thread owned by the logger.
+       *
+       * When true, 'print' only formats the message and enqueues it into a
+       * bounded in-memory queue. The writer thread drains the queue, writes to
+       * the enabled standard outputs, and performs all flushing and splitting
+       * of the log file, so producers never pay for file I/O.
+       */
+      bool async_mode{false};
 
-   /**
-      @brief A logger class for writing log messages to a file.
-      @tparam LogFileNameOrPath The file or path name of the logger. If not provided, it defaults to 'notatarius'.
-      @tparam Options The options for configuring the logger. Defaults to an empty notarius_opts_t struct.
-   */
-   template <slx::string_literal LogFileNameOrPath, notarius_opts_t Options>
-   struct notarius_t final
-   {
-     private:
-      static constexpr std::string_view default_logger_name_or_path{LogFileNameOrPath};
+      /**
+       * @brief The capacity of the async queue.
+       *
+       * Producers block when a message does not fit into the queue until the
+       * writer thread has drained it. The writer is woken early once the queue
+       * is half full.
+       *
+       * 'async_mode' must be true
+       *
+       */
+      size_t async_queue_capacity_bytes{1'048'576 * 4}; // 4 MB
 
-      mutable std::string log_output_file_path_{get_log_file_path(default_logger_name_or_path.data())};
+      /**
+       * @brief The longest time a message waits in the async queue before the
+       *        writer thread picks it up.
+       *
+       * 'async_mode' must be true
+       *
+       */
+      size_t async_flush_interval_ms{5};
 
-      std::shared_ptr<std::shared_mutex> mutex_ = std::make_shared<std::shared_mutex>();
+      /**
+       * @brief What happens to a message logged while the async queue, or a
+       *        thread's buffer (see: 'per_thread_buffers'), is full.
+       *
+       * Dropped messages are counted (see: 'notarius_t::dropped_messages') and
+       * the writer thread logs a "N messages dropped" warning in their place.
+       *
+       */
+      overflow_policy async_overflow_policy{overflow_policy::block};
 
-      // The logging store.
-      // using std::string as the store is slightly faster:
-      // std::deque<std::string> logging_store_;
-      //
-      std::string logging_store_;
-      std::string cout_store_;
-      std::string cerr_store_;
-      std::string clog_store_;
+      /**
+       * @brief With 'overflow_policy::drop_below_level', messages below this
+       *        level are dropped when the queue is full.
+       */
+      log_level async_overflow_level{log_level::warn};
 
-      std::atomic_bool reserve_once{true};
+      /**
+       * @brief Stage messages in per-thread buffers instead of a shared store.
+       *
+       * Each producer thread appends to its own buffer, registered with the
+       * logger on first use, so 'print' no longer takes the logger's mutex.
+       * Every message is stamped with a global sequence number; the writer
+       * thread (see: 'async_mode') collects the buffers and merges them back
+       * into the original order before writing. The writer thread is started
+       * even if 'async_mode' is false. A thread whose buffer exceeds
+       * 'async_queue_capacity_bytes' waits until the writer has collected it.
+       */
+      bool per_thread_buffers{false};
 
-      void reserve_store_capacities()
-      {
-         if (logging_store_.capacity() < options_.split_log_file_at_size_bytes) {
-            logging_store_.reserve(options_.split_log_file_at_size_bytes);
-         }
+      /**
+       * @brief Defer formatting to the writer thread.
+       *
+       * When true and either 'async_mode' or 'per_thread_buffers' is enabled,
+       * 'print' does not format the message. Instead it copies the arguments
+       * (arithmetic values, pointers and the characters of string arguments)
+       * together with a pointer to the format string into the record, and the
+       * writer thread formats it. Calls with any other argument type are
+       * formatted on the calling thread as usual.
+       *
+       * The record refers to the format string by an id (see: 'format_counts'),
+       * which is looked up by the address of the format string, so format strings
+       * must have static storage duration (e.g., a string literal).
+       */
+      bool deferred_format{false};
 
-         if (cout_store_.capacity() < options_.flush_to_std_outputs_at_bytes) {
-            cout_store_.reserve(options_.flush_to_std_outputs_at_bytes);
-         }
+      /**
+       * @brief The size of each segment used by the lock-free append path.
+       *
+       * Messages larger than a segment are appended with the mutex held.
+       *
+       * 'lock_free_enabled' must be true
+       *
+       */
+      size_t lock_free_segment_bytes{1'048'576}; // 1 MB
 
-         if (cerr_store_.capacity() < options_.flush_to_std_outputs_at_bytes) {
-            cerr_store_.reserve(options_.flush_to_std_outputs_at_bytes);
-         }
+      /**
+       * @brief The maximum number of messages passed to a single 'forward_to' call.
+       *
+       * Forwarded messages are queued and delivered by a forwarding thread owned
+       * by the logger, in batches of up to this many messages.
+       */
+      size_t forward_batch_size{1024};
 
-         if (cout_store_.capacity() < options_.flush_to_std_outputs_at_bytes) {
-            cerr_store_.reserve(options_.flush_to_std_outputs_at_bytes);
-         }
-      }
+      /**
+       * @brief The capacity of the forwarding queue.
+       *
+       * A thread that forwards a message while the queue is full waits until the
+       * forwarding thread has taken the queued messages.
+       */
+      size_t forward_queue_capacity_bytes{1'048'576}; // 1 MB
 
-      std::ofstream log_output_stream_;
+      /**
+       * @brief The lowest level that is logged.
+       *
+       * Calls to 'print<level>' (and 'info', 'warn', 'error', ...) below this
+       * level compile to nothing: the message is neither formatted nor written.
+       * Levels are ordered as declared. Messages without a level ('log_level::none',
+       * e.g., 'print(...)' and 'operator()') are not filtered: they are always logged.
+       *
+       * To also skip evaluating the arguments, use 'NOTARIUS_LOG'.
+       */
+      log_level min_level{log_level::none};
 
-      // Toggle writing to the ostream on/logging_off at some logging point in your code.
+      /**
+       * @brief Prefix each message with the date and time it was logged,
+       *        e.g., "2024-05-01 13:45:30.123456 info: message".
+       *
+       * The date and time are formatted once per second on each thread; for
+       * every message only the fraction of the second is written.
+       */
+      bool enable_timestamps{false};
+      bool utc_timestamps{false}; ///< Write timestamps in UTC instead of local time.
+      size_t timestamp_subsecond_digits{6}; ///< Digits written for the fraction of a second: 0 to 9.
+
+      /**
+       * @brief The clock that timestamps are read from.
+       *
+       * A timestamp is taken as a 64-bit tick of this clock. With 'deferred_format'
+       * only the tick is taken on the logging thread, and the writer thread converts
+       * it to the date and time.
+       */
+      clock_source timestamp_clock{clock_source::system};
+
+      /**
+       * @brief The layout of each message, parsed at compile time.
+       *
+       * e.g., "%Y-%m-%d %H:%M:%S.%f [%l] [%t] %v"
+       *
+       * - %Y, %m, %d, %H, %M, %S: the date and time (see: 'utc_timestamps', 'timestamp_clock')
+       * - %e, %f, %F: the milliseconds, microseconds or nanoseconds within the second
+       * - %l: the log level label
+       * - %t: a number identifying the logging thread
+       * - %v: the message
+       * - %%: a '%'
+       *
+       * When empty (the default) a message is laid out as "level: message", with the
+       * timestamp of 'enable_timestamps' in front.
+       */
+      log_pattern_t pattern{};
+
+      /**
+       * @brief Write the log file in the binary format of 'slx::nlog' instead of text.
+       *
+       * A message is written as the id of its format string, its timestamp, level and
+       * thread, and its raw arguments, so it is not formatted for the log file at all.
+       * The 'nlog-decode' tool renders a binary log back to the text that would have been
+       * written otherwise. The standard outputs and 'forward_to' still receive text.
+       *
+       * Arithmetic, string and pointer arguments are encoded; messages with other
+       * arguments are formatted and written as text records. As with 'deferred_format',
+       * format strings must have static storage duration. 'lock_free_enabled' is ignored.
+       * The default extension of split log files becomes ".nlog".
+       */
+      bool binary_format{false};
+
+      /**
+       * @brief Count the calls to 'print' made with each format string; see 'slx::format_counts'.
+       *
+       * Counts are kept per process, for every logger with this option set.
+       */
+      bool count_format_uses{false};
+
+      /**
+       * @brief Write the log file through a memory mapping instead of 'std::ofstream'.
+       *
+       * The log file is extended by 'split_log_file_at_size_bytes' at a time (a single
+       * segment per file when 'split_log_files' is set), and writing the logging store
+       * copies it into the mapping instead of calling write(2); the kernel writes the pages
+       * back. The file is truncated to the bytes logged when it is closed. If the process
+       * exits without closing the logger, the file is left padded with zero bytes.
+       *
+       * Ignored where mmap is not available (e.g., Windows).
+       */
+      bool memory_mapped_file{false};
+
+      /**
+       * @brief Write the log file through io_uring (Linux only).
+       *
+       * Each handed-off logging store is submitted as a write without waiting for it to
+       * complete, so up to 'io_uring_queue_depth' writes are in flight; their buffers are
+       * reused as they complete. 'flush' and 'close' wait for the writes in flight. Where
+       * io_uring is unavailable the writes fall back to pwrite(2). Ignored on other
+       * platforms and when 'memory_mapped_file' is set.
+       */
+      bool io_uring_file{false};
+      size_t io_uring_queue_depth{4}; ///< The number of writes kept in flight with 'io_uring_file'.
+
+      /**
+       * @brief Open the log file with O_DIRECT, so writing it bypasses the page cache.
+       *
+       * Meant for high-volume logs that would otherwise evict the application's data from
+       * the page cache. Each handed-off logging store is copied into a 4 KiB aligned buffer
+       * and written as whole blocks; the partial block at the end of the file is written zero
+       * padded, the padding is truncated away, and the block is rewritten by the next write.
+       * 'flush_to_log_at_bytes' and 'split_log_file_at_size_bytes' are rounded up to 4 KiB.
+       *
+       * Where the file system does not support O_DIRECT the same writes go through the page
+       * cache. Ignored where O_DIRECT is not available (e.g., Windows and macOS) and when
+       * 'memory_mapped_file' or 'io_uring_file' is set.
+       */
+      bool direct_io_file{false};
+
+      /**
+       * @brief Preallocate each log file to 'split_log_file_at_size_bytes' when it is opened.
+       *
+       * Appending to a growing file makes the file system allocate extents and update
+       * metadata as it goes, which shows up as latency jitter in the writes. With this
+       * option the blocks are allocated up front with fallocate(2) without changing the
+       * file's size, and the unused ones are released when the file is split or closed.
+       * With 'memory_mapped_file', each segment is allocated as the file is extended
+       * instead of leaving it sparse, so a full disk is reported when extending rather
+       * than as SIGBUS when writing.
+       *
+       * Only applies when 'split_log_files' is set. Ignored with 'direct_io_file' and
+       * where fallocate(2) is not available (Linux only).
+       */
+      bool preallocate_log_files{false};
+
+      /**
+       * @brief Also split the log file once it has been open this many seconds (0: never).
+       *
+       * The file is split at the first write to it after the interval has elapsed, so a
+       * quiet log is not split into empty files. 'split_log_files' must be true.
+       */
+      size_t split_log_file_interval_seconds{0};
+
+      /**
+       * @brief Compress each log file that has been split off to an LZ4 frame (see: 'slx::lz4').
+       *
+       * Once the logger moves on to the next file, the file it closed is compressed by a
+       * background thread while it is still in the page cache, and 'app_1.log' is replaced
+       * by 'app_1.log.lz4'. The file being written is not compressed. 'close' waits for the
+       * files queued so far. Decompress with the 'nlog-decompress' tool, 'lz4 -d', or
+       * 'slx::lz4::decompress'; 'nlog-decode' reads compressed binary logs directly.
+       */
+      bool compress_split_log_files{false};
+
+      /**
+       * @brief Write the log file as a sequence of LZ4 frames, one per flush (see: 'slx::lz4').
+       *
+       * Each handed-off logging store is compressed on the thread that writes it (the writer
+       * thread with 'async_mode') before it goes to the log file, trading CPU for far fewer
+       * bytes written. Every frame decodes on its own, so a crash loses at most the frame
+       * being written. 'split_log_file_at_size_bytes' applies to the compressed size.
+       * '.lz4' is appended to the default extension of split log files, and
+       * 'compress_split_log_files' is ignored. Read the log with the 'nlog-decompress' tool
+       * or 'lz4 -d'; do not write to the log file through 'rdbuf'.
+       */
+      bool compress_log_files{false};
+
+      /**
+       * @brief Keep at most this many log files that have been split off (0: no limit).
+       *
+       * Once the logger moves on to the next file, a background thread removes the oldest
+       * split-off files of the log, those left by earlier runs included, until both this
+       * limit and 'max_split_log_files_bytes' hold. The file being written is not counted.
+       */
+      size_t max_split_log_files{0};
+
+      /**
+       * @brief Keep at most this many bytes of log files that have been split off (0: no limit).
+       *
+       * Enforced with 'max_split_log_files', counting the size of each file once it has been
+       * compressed (see: 'compress_split_log_files'). The log directory holds up to this plus
+       * 'split_log_file_at_size_bytes'.
+       */
+      size_t max_split_log_files_bytes{0};
+   };
+
+   namespace detail
+   {
+      // The header preceding each message in the async queue.
       //
-      std::atomic_bool toggle_immediate_mode_ = {false};
+      struct record_header_t final
+      {
+         uint32_t size{}; ///< The size of the message following the header.
+         log_level level{log_level::none};
+         bool immediate{}; ///< The message was written with 'notarius_t::write'.
+         bool deferred{}; ///< The message is a 'deferred_record_t' followed by the encoded arguments.
+         bool binary{}; ///< The message is a 'binary_record_t' followed by the encoded arguments.
+      };
 
-      notarius_opts_t options_{Options};
+      // A fixed size buffer of the lock-free append path (see: 'notarius_opts_t::lock_free_enabled').
+      //
+      // Producers reserve space with a fetch-add on 'reserved' and copy their message in. The
+      // producer whose reservation crosses the end of the segment seals it: it records the bytes
+      // in use in 'sealed_size', publishes the segment to the flusher and installs a replacement.
+      //
+      struct log_segment_t final
+      {
+         explicit log_segment_t(const size_t capacity)
+            : data(std::make_unique_for_overwrite<char[]>(capacity)), capacity(capacity)
+         {}
+
+         std::unique_ptr<char[]> data;
+         const size_t capacity;
+         std::atomic<size_t> reserved{}; ///< Bytes reserved by producers; exceeds 'capacity' once sealed.
+         std::atomic<size_t> writers{}; ///< Producers that may be copying into the segment.
+         size_t sealed_size{}; ///< Bytes in use, published along with the segment.
+         log_segment_t* next_sealed{};
+      };
 
-      std::shared_ptr<std::shared_mutex> get_mutex() { return mutex_; }
+      // Deferred formatting (see: 'notarius_opts_t::deferred_format').
+      //
+      template <typename T>
+      concept is_deferred_string = std::is_convertible_v<std::decay_t<T>, std::string_view> &&
+                                   not std::is_same_v<std::decay_t<T>, std::nullptr_t>;
 
-      // Method to get a unique lock for exclusive write access
-      std::unique_lock<std::shared_mutex> get_exclusive_write_lock()
+      template <typename T>
+      concept is_deferred_value =
+         std::is_arithmetic_v<std::decay_t<T>> || std::is_same_v<std::decay_t<T>, const void*> ||
+         std::is_same_v<std::decay_t<T>, void*> || std::is_same_v<std::decay_t<T>, std::nullptr_t>;
+
+      template <typename T>
+      concept is_deferrable = is_deferred_string<T> || is_deferred_value<T>;
+
+      // A small number identifying the calling thread, in the order threads first ask for it.
+      //
+      inline uint32_t this_thread_number()
       {
-         return std::unique_lock<std::shared_mutex>(*mutex_);
+         static std::atomic<uint32_t> count{};
+         static thread_local const uint32_t number = ++count;
+         return number;
       }
 
-      // Method to get a shared lock for shared read access
-      std::shared_lock<std::shared_mutex> get_shared_read_lock() const
+      // Lets an unordered container of std::string be searched with a std::string_view.
+      //
+      struct string_hash final
       {
-         return std::shared_lock<std::shared_mutex>(*mutex_);
-      }
+         using is_transparent = void;
+         size_t operator()(const std::string_view str) const noexcept { return std::hash<std::string_view>{}(str); }
+      };
 
-      // Method to try acquiring an exclusive write lock with retries
-      std::optional<std::unique_lock<std::shared_mutex>> try_exclusive_write_lock(const int max_attempts = 3,
-                                                                                  const int delay_ms = 10)
+      // The format strings used with 'notarius_t::print', interned once per process. A format
+      // string gets the next id the first time it is used, and keeps it for the life of the
+      // process. Entries live in fixed-size chunks that are never moved, so an entry can be
+      // read by id without taking the lock.
+      //
+      class format_table_t final
       {
-         std::unique_lock<std::shared_mutex> cs(*mutex_, std::try_to_lock);
+        public:
+         struct entry_t final
+         {
+            std::string text;
+            std::atomic<uint64_t> uses{}; ///< See: 'notarius_opts_t::count_format_uses'.
+         };
+
+         static format_table_t& instance()
+         {
+            static format_table_t table;
+            return table;
+         }
 
-         for (int attempts = 0; !cs.owns_lock() && attempts < max_attempts; ++attempts) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
-            if (cs.try_lock()) break;
+         format_table_t() = default;
+         format_table_t(const format_table_t&) = delete;
+         format_table_t& operator=(const format_table_t&) = delete;
+
+         ~format_table_t()
+         {
+            for (auto& chunk : chunks_) delete chunk.load();
          }
 
-         if (cs.owns_lock()) {
-            return std::optional<std::unique_lock<std::shared_mutex>>(std::move(cs));
+         uint32_t intern(const std::string_view fmt)
+         {
+            std::lock_guard lock(mutex_);
+
+            if (const auto it = ids_.find(fmt); it != ids_.end()) return it->second;
+
+            const uint32_t id = size_.load(std::memory_order_relaxed);
+            if (id / chunk_size >= max_chunks) throw std::length_error("too many distinct format strings");
+
+            auto& chunk = chunks_[id / chunk_size];
+            if (not chunk.load(std::memory_order_relaxed)) chunk.store(new chunk_t, std::memory_order_release);
+
+            auto& entry = (*chunk.load(std::memory_order_relaxed))[id % chunk_size];
+            entry.text = fmt;
+            ids_.emplace(entry.text, id);
+
+            size_.store(id + 1, std::memory_order_release);
+            return id;
          }
 
-         return std::nullopt;
-      }
+         // 'id' must have been returned by 'intern'.
+         //
+         entry_t& entry(const uint32_t id)
+         {
+            return (*chunks_[id / chunk_size].load(std::memory_order_acquire))[id % chunk_size];
+         }
 
-      // A delegate to forward a log message to. This is run on a separate thread.
-      //
-      std::function<void(std::string_view)> forward_to;
+         uint32_t size() const { return size_.load(std::memory_order_acquire); }
 
-      // notarius helper method; flush a msg to an ostream
+        private:
+         static constexpr size_t chunk_size = 1024;
+         static constexpr size_t max_chunks = 4096;
+         using chunk_t = std::array<entry_t, chunk_size>;
+
+         std::mutex mutex_;
+         std::unordered_map<std::string, uint32_t, string_hash, std::equal_to<>> ids_;
+         std::array<std::atomic<chunk_t*>, max_chunks> chunks_{};
+         std::atomic<uint32_t> size_{};
+      };
+
+      // Returns the id of 'fmt' in the 'format_table_t'. Each thread caches ids by the address
+      // of the format string, which has static storage duration, so the table's lock is only
+      // taken the first time a thread uses a format string.
       //
-      template <log_level level, bool flush = true, is_loggable... Args>
-      void update_io_buffer(std::ostream& buffer, std::format_string<Args...> fmt, Args&&... args)
+      inline uint32_t format_id(const std::string_view fmt)
       {
-         static thread_local std::string msg;
-
-         if constexpr (log_level::none == level)
-            msg = std::format(fmt, std::forward<Args>(args)...);
-         else
-            msg = std::format("{}: {}", to_string(level), std::format(fmt, std::forward<Args>(args)...));
+         static thread_local std::unordered_map<const char*, uint32_t> ids;
 
-         buffer.write(msg.c_str(), msg.size());
+         auto [it, inserted] = ids.try_emplace(fmt.data());
+         if (inserted) it->second = format_table_t::instance().intern(fmt);
+         return it->second;
+      }
 
-         buffer.flush();
+      struct deferred_record_t final
+      {
+         void (*render)(std::string& out, std::string_view fmt, const char* args){};
+         uint32_t format{}; ///< The id of the format string (see: 'format_table_t').
+         int64_t time{}; ///< When the message was logged, in ticks of 'notarius_opts_t::timestamp_clock'.
+         uint32_t thread{}; ///< The logging thread (see: 'this_thread_number').
+      };
 
-         msg.clear();
+      // Strings are stored as their size followed by their characters, values as their bytes.
+      //
+      template <is_deferrable T>
+      void encode_argument(std::string& out, const T& arg)
+      {
+         if constexpr (is_deferred_string<T>) {
+            const std::string_view str{arg};
+            const auto size = static_cast<uint32_t>(str.size());
+            out.append(reinterpret_cast<const char*>(&size), sizeof(size));
+            out.append(str);
+         }
+         else {
+            const std::decay_t<T> value = arg;
+            out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+         }
       }
 
-      void flush_cout()
+      template <is_deferrable T>
+      auto decode_argument(const char*& args)
       {
-         if (are_rdbufs_equal(log_output_stream_, std::cout)) {
-            flush();
-            cout_store_.clear();
-            return;
+         if constexpr (is_deferred_string<T>) {
+            uint32_t size{};
+            std::memcpy(&size, args, sizeof(size));
+            const std::string_view str{args + sizeof(size), size};
+            args += sizeof(size) + size;
+            return str;
+         }
+         else {
+            std::decay_t<T> value;
+            std::memcpy(&value, args, sizeof(value));
+            args += sizeof(value);
+            return value;
          }
-         if (cout_store_.empty()) return;
-         std::cout << cout_store_;
-         cout_store_.clear();
-         std::cout.flush();
       }
 
-      void flush_cerr()
+      template <is_deferrable... Args>
+      void render_deferred(std::string& out, const std::string_view fmt, const char* args)
       {
-         if (are_rdbufs_equal(log_output_stream_, std::cerr)) {
-            flush();
-            cerr_store_.clear();
+         // Braced initialization decodes the arguments from left to right.
+         std::tuple<decltype(decode_argument<Args>(args))...> values{decode_argument<Args>(args)...};
+         std::apply(
+            [&](auto&... value) { std::vformat_to(std::back_inserter(out), fmt, std::make_format_args(value...)); },
+            values);
+      }
+
+      template <is_deferrable... Args>
+      void encode_deferred(std::string& out, const uint32_t format, const int64_t time, const Args&... args)
+      {
+         const deferred_record_t record{&render_deferred<Args...>, format, time, this_thread_number()};
+         out.assign(reinterpret_cast<const char*>(&record), sizeof(record));
+         (encode_argument(out, args), ...);
+      }
+
+      // A message on its way to a binary log (see: 'notarius_opts_t::binary_format'), followed
+      // by its arguments encoded as in a message record (see: 'nlog::encode_argument').
+      //
+      struct binary_record_t final
+      {
+         uint32_t format{}; ///< The id of the format string (see: 'format_table_t').
+         int64_t time{}; ///< When the message was logged, in ticks of 'notarius_opts_t::timestamp_clock'.
+         uint32_t thread{}; ///< The logging thread (see: 'this_thread_number').
+      };
+
+      template <class Clock>
+      int64_t clock_ns()
+      {
+         return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+      }
+
+      inline int64_t read_tsc()
+      {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+         return static_cast<int64_t>(__rdtsc());
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+         return static_cast<int64_t>(__builtin_ia32_rdtsc());
+#elif (defined(__GNUC__) || defined(__clang__)) && defined(__aarch64__)
+         int64_t ticks;
+         asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+         return ticks;
+#else
+         return clock_ns<std::chrono::steady_clock>();
+#endif
+      }
+
+      // Maps time stamp counter ticks to nanoseconds since the epoch. The mapping is anchored
+      // to a (tick, system_clock) sample taken about once a second, and the tick rate is taken
+      // from the last two samples. Readers get a consistent anchor through a sequence lock.
+      //
+      struct tsc_clock_t final
+      {
+         static tsc_clock_t& instance()
+         {
+            static tsc_clock_t clock;
+            return clock;
+         }
+
+         int64_t to_epoch_ns(const int64_t ticks)
+         {
+            if (ticks - ticks_.load(std::memory_order_relaxed) > ticks_per_anchor_) reanchor();
+
+            while (true) {
+               const uint64_t seq = seq_.load(std::memory_order_acquire);
+               if (seq & 1) continue;
+               const int64_t anchor_ticks = ticks_.load(std::memory_order_acquire);
+               const int64_t anchor_ns = ns_.load(std::memory_order_acquire);
+               const double ns_per_tick = ns_per_tick_.load(std::memory_order_acquire);
+               if (seq_.load(std::memory_order_relaxed) == seq) {
+                  return anchor_ns + static_cast<int64_t>(static_cast<double>(ticks - anchor_ticks) * ns_per_tick);
+               }
+            }
+         }
+
+        private:
+         struct sample_t final
+         {
+            int64_t ticks{};
+            int64_t ns{};
+         };
+
+         static sample_t sample()
+         {
+            const int64_t before = read_tsc();
+            const int64_t ns = clock_ns<std::chrono::system_clock>();
+            const int64_t after = read_tsc();
+            return {before + (after - before) / 2, ns};
+         }
+
+         // The first rate is measured over about a millisecond.
+         tsc_clock_t()
+         {
+            const sample_t first = sample();
+            sample_t second = sample();
+            while (second.ns - first.ns < 1'000'000) second = sample();
+            store(second, double(second.ns - first.ns) / double(std::max<int64_t>(second.ticks - first.ticks, 1)));
+            ticks_per_anchor_ = static_cast<int64_t>(1e9 / ns_per_tick_.load());
+         }
+
+         void reanchor()
+         {
+            std::unique_lock lock(mutex_, std::try_to_lock);
+            if (not lock.owns_lock()) return;
+
+            const sample_t next = sample();
+            const int64_t elapsed_ticks = next.ticks - ticks_.load(std::memory_order_relaxed);
+            if (elapsed_ticks <= ticks_per_anchor_) return; // another thread has just re-anchored
+
+            double ns_per_tick = double(next.ns - ns_.load(std::memory_order_relaxed)) / double(elapsed_ticks);
+            // Keep the previous rate when the wall clock has been set back.
+            if (ns_per_tick <= 0) ns_per_tick = ns_per_tick_.load(std::memory_order_relaxed);
+            store(next, ns_per_tick);
+         }
+
+         void store(const sample_t anchor, const double ns_per_tick)
+         {
+            const uint64_t seq = seq_.load(std::memory_order_relaxed);
+            // A reader that loads any of the new values also sees the odd sequence number.
+            seq_.store(seq + 1, std::memory_order_relaxed);
+            ticks_.store(anchor.ticks, std::memory_order_release);
+            ns_.store(anchor.ns, std::memory_order_release);
+            ns_per_tick_.store(ns_per_tick, std::memory_order_release);
+            seq_.store(seq + 2, std::memory_order_release);
+         }
+
+         std::mutex mutex_; ///< Held while re-anchoring.
+         std::atomic<uint64_t> seq_{}; ///< Odd while the anchor is being stored.
+         std::atomic<int64_t> ticks_{};
+         std::atomic<int64_t> ns_{};
+         std::atomic<double> ns_per_tick_{1.0};
+         int64_t ticks_per_anchor_{};
+      };
+
+      // Reads a 64-bit tick of 'clock'; see 'ticks_to_epoch_ns'.
+      //
+      inline int64_t clock_ticks(const clock_source clock)
+      {
+         switch (clock) {
+         case clock_source::steady:
+            return clock_ns<std::chrono::steady_clock>();
+         case clock_source::realtime_coarse: {
+#if defined(__linux__)
+            timespec ts{};
+            clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+            return int64_t(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+#else
+            return clock_ns<std::chrono::system_clock>();
+#endif
+         }
+         case clock_source::tsc:
+            return read_tsc();
+         default:
+            return clock_ns<std::chrono::system_clock>();
+         }
+      }
+
+      // Converts a tick of 'clock' to nanoseconds since the epoch.
+      //
+      inline int64_t ticks_to_epoch_ns(const clock_source clock, const int64_t ticks)
+      {
+         switch (clock) {
+         case clock_source::steady: {
+            static const int64_t offset = clock_ns<std::chrono::system_clock>() - clock_ns<std::chrono::steady_clock>();
+            return ticks + offset;
+         }
+         case clock_source::tsc:
+            return tsc_clock_t::instance().to_epoch_ns(ticks);
+         default:
+            return ticks;
+         }
+      }
+
+      // The broken-down date and time of a second since the epoch, with its "yyyy-mm-dd hh:mm:ss"
+      // text. Cached per thread, so the conversion only runs when the second changes.
+      //
+      struct cached_second_t final
+      {
+         int64_t second{INT64_MIN};
+         bool utc{};
+         std::tm tm{};
+         std::array<char, 20> text{};
+         size_t size{};
+      };
+
+      inline const cached_second_t& cached_second(const int64_t second, const bool utc)
+      {
+         static thread_local cached_second_t cache;
+
+         if (second != cache.second or utc != cache.utc) {
+            const std::time_t t = static_cast<std::time_t>(second);
+#ifdef _WIN32
+            utc ? gmtime_s(&cache.tm, &t) : localtime_s(&cache.tm, &t);
+#else
+            utc ? gmtime_r(&t, &cache.tm) : localtime_r(&t, &cache.tm);
+#endif
+            cache.size = std::strftime(cache.text.data(), cache.text.size(), "%Y-%m-%d %H:%M:%S", &cache.tm);
+            cache.second = second;
+            cache.utc = utc;
+         }
+
+         return cache;
+      }
+
+      // Splits nanoseconds since the epoch into seconds and the nanoseconds within the second.
+      //
+      inline std::pair<int64_t, int64_t> split_seconds(const int64_t time)
+      {
+         constexpr int64_t ns_per_sec = 1'000'000'000;
+         int64_t second = time / ns_per_sec;
+         int64_t nanoseconds = time % ns_per_sec;
+         if (nanoseconds < 0) {
+            --second;
+            nanoseconds += ns_per_sec;
+         }
+         return {second, nanoseconds};
+      }
+
+      // Appends the 'digits' most significant digits of a 9 digit, zero padded 'value'.
+      //
+      inline void append_fraction(std::string& out, int64_t value, const size_t digits)
+      {
+         std::array<char, 9> text{};
+         for (size_t i = 9; i > 0; --i, value /= 10) {
+            text[i - 1] = static_cast<char>('0' + value % 10);
+         }
+         out.append(text.data(), std::min<size_t>(digits, 9));
+      }
+
+      // Appends "yyyy-mm-dd hh:mm:ss.fraction " for 'time' (nanoseconds since the epoch) to
+      // 'out'. The date and time are only formatted when the second changes on this thread.
+      //
+      inline void append_timestamp(std::string& out, const int64_t time, const bool utc, const size_t subsecond_digits)
+      {
+         const auto [second, nanoseconds] = split_seconds(time);
+         const auto& cache = cached_second(second, utc);
+
+         out.append(cache.text.data(), cache.size);
+
+         if (subsecond_digits > 0) {
+            out.push_back('.');
+            append_fraction(out, nanoseconds, subsecond_digits);
+         }
+
+         out.push_back(' ');
+      }
+
+      // clang-format off
+      enum class pattern_field : uint8_t {
+          text,    ///< Literal text from the pattern.
+          year,    ///< %Y
+          month,   ///< %m
+          day,     ///< %d
+          hour,    ///< %H
+          minute,  ///< %M
+          second,  ///< %S
+          millis,  ///< %e
+          micros,  ///< %f
+          nanos,   ///< %F
+          level,   ///< %l
+          thread,  ///< %t
+          message  ///< %v
+      };
+      // clang-format on
+
+      struct pattern_token_t final
+      {
+         pattern_field field{pattern_field::text};
+         size_t begin{}; ///< The start of the literal text in the pattern.
+         size_t size{}; ///< The size of the literal text.
+      };
+
+      struct parsed_pattern_t final
+      {
+         std::array<pattern_token_t, log_pattern_t::max_size> tokens{};
+         size_t size{};
+         bool has_time{};
+      };
+
+      constexpr parsed_pattern_t parse_pattern(const log_pattern_t& pattern)
+      {
+         parsed_pattern_t parsed;
+
+         auto add_text = [&](const size_t begin) {
+            if (parsed.size > 0) {
+               auto& last = parsed.tokens[parsed.size - 1];
+               if (last.field == pattern_field::text and last.begin + last.size == begin) {
+                  ++last.size;
+                  return;
+               }
+            }
+            parsed.tokens[parsed.size++] = {pattern_field::text, begin, 1};
+         };
+
+         for (size_t i = 0; i < pattern.size; ++i) {
+            if (pattern.value[i] != '%') {
+               add_text(i);
+               continue;
+            }
+
+            if (++i == pattern.size) throw "log pattern ends with '%'";
+
+            pattern_field field{};
+            switch (pattern.value[i]) {
+            case '%':
+               add_text(i);
+               continue;
+            case 'Y':
+               field = pattern_field::year;
+               break;
+            case 'm':
+               field = pattern_field::month;
+               break;
+            case 'd':
+               field = pattern_field::day;
+               break;
+            case 'H':
+               field = pattern_field::hour;
+               break;
+            case 'M':
+               field = pattern_field::minute;
+               break;
+            case 'S':
+               field = pattern_field::second;
+               break;
+            case 'e':
+               field = pattern_field::millis;
+               break;
+            case 'f':
+               field = pattern_field::micros;
+               break;
+            case 'F':
+               field = pattern_field::nanos;
+               break;
+            case 'l':
+               field = pattern_field::level;
+               break;
+            case 't':
+               field = pattern_field::thread;
+               break;
+            case 'v':
+               field = pattern_field::message;
+               break;
+            default:
+               throw "unknown log pattern flag";
+            }
+
+            parsed.has_time = parsed.has_time or (field >= pattern_field::year and field <= pattern_field::nanos);
+            parsed.tokens[parsed.size++] = {field};
+         }
+
+         return parsed;
+      }
+
+      template <log_pattern_t Pattern>
+      inline constexpr parsed_pattern_t parsed_pattern = parse_pattern(Pattern);
+
+      // What a log pattern is expanded with.
+      //
+      struct pattern_context_t final
+      {
+         int64_t time{}; ///< Nanoseconds since the epoch.
+         bool utc{};
+         log_level level{};
+         uint32_t thread{};
+      };
+
+      template <size_t Digits>
+      void append_number(std::string& out, int value)
+      {
+         std::array<char, Digits> text{};
+         for (size_t i = Digits; i > 0; --i, value /= 10) {
+            text[i - 1] = static_cast<char>('0' + value % 10);
+         }
+         out.append(text.data(), Digits);
+      }
+
+      // Appends one field of a parsed pattern; 'text' is the literal text of a 'pattern_field::text'.
+      //
+      template <class WriteMessage>
+      inline void append_field(std::string& out, const pattern_field field, const std::string_view text,
+                               const pattern_context_t& context, WriteMessage&& write_message)
+      {
+         switch (field) {
+         case pattern_field::text:
+            out.append(text);
+            return;
+         case pattern_field::level:
+            out.append(to_string(context.level));
+            return;
+         case pattern_field::thread: {
+            std::array<char, 10> digits{};
+            const auto result = std::to_chars(digits.data(), digits.data() + digits.size(), context.thread);
+            out.append(digits.data(), result.ptr);
+            return;
+         }
+         case pattern_field::message:
+            write_message(out);
+            return;
+         default:
+            break;
+         }
+
+         const auto [second, nanoseconds] = split_seconds(context.time);
+
+         switch (field) {
+         case pattern_field::millis:
+            return append_fraction(out, nanoseconds, 3);
+         case pattern_field::micros:
+            return append_fraction(out, nanoseconds, 6);
+         case pattern_field::nanos:
+            return append_fraction(out, nanoseconds, 9);
+         default:
+            break;
+         }
+
+         const std::tm& tm = cached_second(second, context.utc).tm;
+
+         switch (field) {
+         case pattern_field::year:
+            return append_number<4>(out, tm.tm_year + 1900);
+         case pattern_field::month:
+            return append_number<2>(out, tm.tm_mon + 1);
+         case pattern_field::day:
+            return append_number<2>(out, tm.tm_mday);
+         case pattern_field::hour:
+            return append_number<2>(out, tm.tm_hour);
+         case pattern_field::minute:
+            return append_number<2>(out, tm.tm_min);
+         default:
+            return append_number<2>(out, tm.tm_sec);
+         }
+      }
+
+      // Appends 'Pattern' expanded with 'context' to 'out'; 'write_message' appends the message
+      // at '%v'. The pattern is parsed at compile time, so this unrolls into the appends for each
+      // field in turn.
+      //
+      template <log_pattern_t Pattern, size_t I = 0, class WriteMessage>
+      void emit_pattern(std::string& out, const pattern_context_t& context, WriteMessage&& write_message)
+      {
+         constexpr auto& parsed = parsed_pattern<Pattern>;
+
+         if constexpr (I < parsed.size) {
+            constexpr pattern_token_t token = parsed.tokens[I];
+            append_field(out, token.field, Pattern.sv().substr(token.begin, token.size), context, write_message);
+            emit_pattern<Pattern, I + 1>(out, context, std::forward<WriteMessage>(write_message));
+         }
+      }
+
+      // Appends a pattern parsed at run time (e.g., when decoding a binary log) to 'out'.
+      //
+      template <class WriteMessage>
+      void emit_pattern(std::string& out, const std::string_view pattern, const parsed_pattern_t& parsed,
+                        const pattern_context_t& context, WriteMessage&& write_message)
+      {
+         for (size_t i = 0; i < parsed.size; ++i) {
+            const auto& token = parsed.tokens[i];
+            append_field(out, token.field, pattern.substr(token.begin, token.size), context, write_message);
+         }
+      }
+
+      // A buffer owned by a single producer thread (see: 'notarius_opts_t::per_thread_buffers').
+      // Each record is a sequence number followed by a 'record_header_t' and the message.
+      //
+      struct staging_buffer_t final
+      {
+         std::mutex mutex; ///< Only taken by the owning thread and the writer thread.
+         std::string records;
+         std::atomic<size_t> size{}; ///< The size of 'records', readable without the lock.
+      };
+
+#if defined(NOTARIUS_HAS_MMAP)
+      // A log file written through a memory mapping (see: 'notarius_opts_t::memory_mapped_file').
+      // The file is extended a segment at a time and the segment at its end is mapped, so an
+      // append is a copy into the mapping and the kernel writes the pages back. The file is
+      // truncated to the bytes appended when it is closed.
+      //
+      class mapped_file_t final
+      {
+        public:
+         mapped_file_t() = default;
+         mapped_file_t(const mapped_file_t&) = delete;
+         mapped_file_t& operator=(const mapped_file_t&) = delete;
+         ~mapped_file_t() { close(); }
+
+         bool open(const std::string& path, const bool append, const size_t segment_bytes, const bool preallocate)
+         {
+            close();
+            preallocate_ = preallocate;
+
+            fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | (append ? 0 : O_TRUNC), 0644);
+            if (fd_ < 0) return false;
+
+            struct stat st{};
+            if (::fstat(fd_, &st) != 0) {
+               close();
+               return false;
+            }
+
+            size_ = static_cast<size_t>(st.st_size);
+            segment_bytes_ = std::max<size_t>((segment_bytes + page_size() - 1) / page_size(), 1) * page_size();
+            return true;
+         }
+
+         bool is_open() const { return fd_ >= 0; }
+
+         size_t size() const { return size_; }
+
+         // Throws std::system_error when the file cannot be extended or mapped.
+         //
+         void append(std::string_view data)
+         {
+            while (not data.empty()) {
+               if (map_ == nullptr or size_ == map_offset_ + map_size_) map_segment();
+
+               const size_t count = std::min(data.size(), map_offset_ + map_size_ - size_);
+               std::memcpy(map_ + (size_ - map_offset_), data.data(), count);
+               size_ += count;
+               data.remove_prefix(count);
+            }
+         }
+
+         void close()
+         {
+            if (fd_ < 0) return;
+
+            unmap();
+            [[maybe_unused]] const int truncated = ::ftruncate(fd_, static_cast<off_t>(size_));
+            ::close(fd_);
+
+            fd_ = -1;
+            size_ = 0;
+         }
+
+        private:
+         static size_t page_size()
+         {
+            static const size_t size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+            return size;
+         }
+
+         // Maps a segment from the page holding the end of the file, extending the file to cover it.
+         //
+         void map_segment()
+         {
+            unmap();
+
+            const size_t offset = size_ / page_size() * page_size();
+            bool extended = false;
+#if defined(NOTARIUS_HAS_FALLOCATE)
+            if (preallocate_) {
+               const int error =
+                  ::posix_fallocate(fd_, static_cast<off_t>(offset), static_cast<off_t>(segment_bytes_));
+               if (error != 0) {
+                  errno = error;
+                  throw_error("extending");
+               }
+               extended = true;
+            }
+#endif
+            if (not extended and ::ftruncate(fd_, static_cast<off_t>(offset + segment_bytes_)) != 0) {
+               throw_error("extending");
+            }
+
+            void* map =
+               ::mmap(nullptr, segment_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, static_cast<off_t>(offset));
+            if (map == MAP_FAILED) throw_error("mapping");
+
+            map_ = static_cast<char*>(map);
+            map_offset_ = offset;
+            map_size_ = segment_bytes_;
+         }
+
+         void unmap()
+         {
+            if (map_ == nullptr) return;
+            ::munmap(map_, map_size_);
+            map_ = nullptr;
+            map_size_ = 0;
+         }
+
+         [[noreturn]] static void throw_error(const char* action)
+         {
+            const std::error_code ec(errno, std::generic_category());
+            throw std::system_error(
+               ec, std::format("Error {} memory mapped log file (error code: {})!", action, ec.message()));
+         }
+
+         int fd_{-1};
+         char* map_{};
+         size_t map_offset_{}; ///< The file offset the mapping starts at.
+         size_t map_size_{};
+         size_t size_{}; ///< The bytes in the file, excluding the unused part of the mapping.
+         size_t segment_bytes_{};
+         bool preallocate_{}; ///< Allocate the segments' blocks rather than leaving them sparse.
+      };
+#endif
+
+#if defined(NOTARIUS_HAS_IO_URING)
+      // A log file written through io_uring (see: 'notarius_opts_t::io_uring_file'). Appends are
+      // submitted as writes at increasing offsets, up to 'queue_depth' of them in flight, and
+      // completions are reaped when a buffer is needed again or on 'wait'. Where io_uring is
+      // unavailable (e.g., disabled by the kernel), appends fall back to pwrite(2).
+      //
+      class uring_file_t final
+      {
+        public:
+         uring_file_t() = default;
+         uring_file_t(const uring_file_t&) = delete;
+         uring_file_t& operator=(const uring_file_t&) = delete;
+         ~uring_file_t()
+         {
+            try {
+               close();
+            }
+            catch (...) {
+            }
+            unmap_ring();
+         }
+
+         bool open(const std::string& path, const bool append, const size_t queue_depth)
+         {
+            close();
+
+            fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (append ? 0 : O_TRUNC), 0644);
+            if (fd_ < 0) return false;
+
+            struct stat st{};
+            if (::fstat(fd_, &st) != 0) {
+               ::close(fd_);
+               fd_ = -1;
+               return false;
+            }
+            size_ = static_cast<size_t>(st.st_size);
+
+            if (not ring_setup_) setup_ring(static_cast<unsigned>(std::clamp<size_t>(queue_depth, 1, 4096)));
+            return true;
+         }
+
+         bool is_open() const { return fd_ >= 0; }
+
+         size_t size() const { return size_; }
+
+         // Queues 'buffer' to be written at the end of the file. 'buffer' is exchanged for an
+         // empty buffer whose write has completed. Throws std::system_error if a write failed.
+         //
+         void append(std::string& buffer)
+         {
+            if (buffer.empty()) return;
+
+            auto slot = slots_.end();
+            while (ring_fd_ >= 0 and
+                   (slot = std::find_if(slots_.begin(), slots_.end(), [](const slot_t& s) { return not s.busy; })) ==
+                      slots_.end()) {
+               reap(true);
+            }
+
+            if (ring_fd_ < 0) { // io_uring is unavailable, or has failed (see: 'reap')
+               write_at(buffer, size_);
+               size_ += buffer.size();
+               buffer.clear();
+               throw_on_error();
+               return;
+            }
+
+            slot->buffer.swap(buffer);
+            buffer.clear();
+            slot->offset = size_;
+            slot->written = 0;
+            slot->busy = true;
+            size_ += slot->buffer.size();
+
+            submit(*slot);
+            reap(false);
+         }
+
+         // Waits until every queued write has completed.
+         //
+         void wait()
+         {
+            while (std::any_of(slots_.begin(), slots_.end(), [](const slot_t& s) { return s.busy; })) reap(true);
+            throw_on_error();
+         }
+
+         void close()
+         {
+            if (fd_ < 0) return;
+
+            try {
+               wait();
+            }
+            catch (...) {
+               ::close(std::exchange(fd_, -1));
+               throw;
+            }
+            ::close(std::exchange(fd_, -1));
+         }
+
+        private:
+         struct slot_t final
+         {
+            std::string buffer;
+            size_t offset{}; ///< Where 'buffer' goes in the file.
+            size_t written{}; ///< The bytes written so far.
+            bool busy{};
+         };
+
+         void setup_ring(const unsigned entries)
+         {
+            ring_setup_ = true;
+
+            io_uring_params params{};
+            const int ring_fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+            if (ring_fd < 0) return;
+            ring_fd_ = ring_fd;
+
+            sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            if (params.features & IORING_FEAT_SINGLE_MMAP) {
+               sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+            }
+
+            const auto map = [&](const size_t size, const off_t offset) {
+               void* ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, offset);
+               return ptr == MAP_FAILED ? nullptr : static_cast<char*>(ptr);
+            };
+
+            sq_ring_ = map(sq_ring_size_, IORING_OFF_SQ_RING);
+            cq_ring_ = (params.features & IORING_FEAT_SINGLE_MMAP) ? sq_ring_ : map(cq_ring_size_, IORING_OFF_CQ_RING);
+            sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+            sqes_ = reinterpret_cast<io_uring_sqe*>(map(sqes_size_, IORING_OFF_SQES));
+
+            if (not sq_ring_ or not cq_ring_ or not sqes_) {
+               unmap_ring();
+               return;
+            }
+
+            sq_head_ = reinterpret_cast<unsigned*>(sq_ring_ + params.sq_off.head);
+            sq_tail_ = reinterpret_cast<unsigned*>(sq_ring_ + params.sq_off.tail);
+            sq_mask_ = *reinterpret_cast<unsigned*>(sq_ring_ + params.sq_off.ring_mask);
+            sq_array_ = reinterpret_cast<unsigned*>(sq_ring_ + params.sq_off.array);
+            cq_head_ = reinterpret_cast<unsigned*>(cq_ring_ + params.cq_off.head);
+            cq_tail_ = reinterpret_cast<unsigned*>(cq_ring_ + params.cq_off.tail);
+            cq_mask_ = *reinterpret_cast<unsigned*>(cq_ring_ + params.cq_off.ring_mask);
+            cqes_ = reinterpret_cast<io_uring_cqe*>(cq_ring_ + params.cq_off.cqes);
+
+            slots_.resize(std::min(entries, params.sq_entries));
+         }
+
+         void unmap_ring()
+         {
+            if (sqes_) ::munmap(sqes_, sqes_size_);
+            if (cq_ring_ and cq_ring_ != sq_ring_) ::munmap(cq_ring_, cq_ring_size_);
+            if (sq_ring_) ::munmap(sq_ring_, sq_ring_size_);
+            sqes_ = nullptr;
+            cq_ring_ = sq_ring_ = nullptr;
+            if (ring_fd_ >= 0) ::close(ring_fd_);
+            ring_fd_ = -1;
+         }
+
+         // Submits the unwritten part of a slot's buffer. The submission queue has room, as no
+         // more writes than slots are ever in flight. If the kernel does not take the write
+         // (see: 'submit_queued'), it is made with pwrite(2) before returning.
+         //
+         void submit(slot_t& slot)
+         {
+            const unsigned tail = *sq_tail_;
+            const unsigned index = tail & sq_mask_;
+
+            io_uring_sqe& sqe = sqes_[index];
+            std::memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = IORING_OP_WRITE;
+            sqe.fd = fd_;
+            sqe.addr = reinterpret_cast<uint64_t>(slot.buffer.data() + slot.written);
+            sqe.len = static_cast<uint32_t>(std::min<size_t>(slot.buffer.size() - slot.written, UINT32_MAX));
+            sqe.off = slot.offset + slot.written;
+            sqe.user_data = static_cast<uint64_t>(&slot - slots_.data());
+
+            sq_array_[index] = index;
+            std::atomic_ref<unsigned>(*sq_tail_).store(tail + 1, std::memory_order_release);
+
+            submit_queued();
+         }
+
+         // Hands the queued submissions to the kernel. Should it refuse them (e.g., EAGAIN or
+         // ENOMEM when it is short of memory), they are taken back off the queue, which the
+         // kernel only reads in 'io_uring_enter', and written with pwrite(2), so no slot is left
+         // busy with a write that was never submitted.
+         //
+         void submit_queued()
+         {
+            const unsigned tail = *sq_tail_;
+            unsigned head = std::atomic_ref<unsigned>(*sq_head_).load(std::memory_order_acquire);
+
+            while (head != tail) {
+               const int error = enter(tail - head, false);
+               const unsigned submitted_to = std::atomic_ref<unsigned>(*sq_head_).load(std::memory_order_acquire);
+               if (error != 0 or submitted_to == head) break;
+               head = submitted_to;
+            }
+            if (head == tail) return;
+
+            std::atomic_ref<unsigned>(*sq_tail_).store(head, std::memory_order_release);
+            for (; head != tail; ++head) {
+               slot_t& slot = slots_[sqes_[sq_array_[head & sq_mask_]].user_data];
+               write_at(std::string_view(slot.buffer).substr(slot.written), slot.offset + slot.written);
+               complete(slot);
+            }
+         }
+
+         // Calls 'io_uring_enter', retrying when interrupted. Returns 0 or the errno.
+         //
+         int enter(const unsigned to_submit, const bool block)
+         {
+            const unsigned flags = block ? IORING_ENTER_GETEVENTS : 0;
+            while (::syscall(__NR_io_uring_enter, ring_fd_, to_submit, block ? 1 : 0, flags, nullptr, 0) < 0) {
+               if (errno != EINTR) return errno;
+            }
+            return 0;
+         }
+
+         // Processes the available completions; with 'block', waits for at least one.
+         //
+         void reap(const bool block)
+         {
+            unsigned head = *cq_head_;
+
+            if (block and head == std::atomic_ref<unsigned>(*cq_tail_).load(std::memory_order_acquire)) {
+               // EAGAIN and EBUSY are transient: the caller reaps and waits again. Any other error
+               // means the ring is unusable, so its writes are given up for lost and later appends
+               // use pwrite(2).
+               if (const int error = enter(0, true); error != 0 and error != EAGAIN and error != EBUSY) {
+                  error_ = error;
+                  for (auto& slot : slots_) complete(slot);
+                  unmap_ring();
+                  return;
+               }
+            }
+
+            for (; head != std::atomic_ref<unsigned>(*cq_tail_).load(std::memory_order_acquire); ++head) {
+               const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+               slot_t& slot = slots_[cqe.user_data];
+
+               if (cqe.res == -EINTR or cqe.res == -EAGAIN) {
+                  submit(slot);
+               }
+               else if (cqe.res < 0 or (cqe.res == 0 and slot.written < slot.buffer.size())) {
+                  error_ = cqe.res < 0 ? -cqe.res : EIO;
+                  complete(slot);
+               }
+               else if (slot.written += static_cast<size_t>(cqe.res); slot.written < slot.buffer.size()) {
+                  submit(slot); // a short write
+               }
+               else {
+                  complete(slot);
+               }
+
+               std::atomic_ref<unsigned>(*cq_head_).store(head + 1, std::memory_order_release);
+            }
+         }
+
+         static void complete(slot_t& slot)
+         {
+            slot.buffer.clear();
+            slot.busy = false;
+         }
+
+         // Writes 'data' at 'offset' with pwrite(2), recording a failure in 'error_'.
+         //
+         void write_at(const std::string_view data, const size_t offset)
+         {
+            for (size_t written = 0; written < data.size();) {
+               const auto result = ::pwrite(fd_, data.data() + written, data.size() - written,
+                                            static_cast<off_t>(offset + written));
+               if (result < 0 and errno == EINTR) continue;
+               if (result <= 0) {
+                  error_ = result < 0 ? errno : EIO;
+                  break;
+               }
+               written += static_cast<size_t>(result);
+            }
+         }
+
+         void throw_on_error()
+         {
+            if (error_ == 0) return;
+            const std::error_code ec(std::exchange(error_, 0), std::generic_category());
+            throw std::system_error(ec, std::format("Error writing log file (error code: {})!", ec.message()));
+         }
+
+         int fd_{-1};
+         size_t size_{}; ///< The size of the file once the queued writes complete.
+         int error_{}; ///< The errno of a failed write, reported by the next 'append' or 'wait'.
+         std::vector<slot_t> slots_;
+
+         bool ring_setup_{};
+         int ring_fd_{-1}; ///< Negative when io_uring is unavailable.
+         char* sq_ring_{};
+         char* cq_ring_{};
+         io_uring_sqe* sqes_{};
+         size_t sq_ring_size_{};
+         size_t cq_ring_size_{};
+         size_t sqes_size_{};
+         unsigned* sq_head_{};
+         unsigned* sq_tail_{};
+         unsigned sq_mask_{};
+         unsigned* sq_array_{};
+         unsigned* cq_head_{};
+         unsigned* cq_tail_{};
+         unsigned cq_mask_{};
+         io_uring_cqe* cqes_{};
+      };
+#endif
+
+#if defined(NOTARIUS_HAS_O_DIRECT)
+      inline constexpr size_t direct_io_alignment = 4096;
+
+      // A log file written with O_DIRECT (see: 'notarius_opts_t::direct_io_file'). O_DIRECT writes
+      // must be whole blocks from an aligned buffer at an aligned offset, so appends are copied into
+      // an aligned buffer after the partial block at the end of the file. That block is written
+      // zero padded and the file is truncated back to its size, so the file never holds padding;
+      // the block is kept to be rewritten, completed, by the next append.
+      //
+      class direct_file_t final
+      {
+        public:
+         direct_file_t() = default;
+         direct_file_t(const direct_file_t&) = delete;
+         direct_file_t& operator=(const direct_file_t&) = delete;
+         ~direct_file_t() { close(); }
+
+         bool open(const std::string& path, const bool append)
+         {
+            close();
+
+            // O_RDWR: an appended file's partial last block is read back into the buffer.
+            const int flags = O_RDWR | O_CREAT | O_CLOEXEC | (append ? 0 : O_TRUNC);
+            fd_ = ::open(path.c_str(), flags | O_DIRECT, 0644);
+            if (fd_ < 0 and errno == EINVAL) fd_ = ::open(path.c_str(), flags, 0644); // e.g., an older tmpfs
+            if (fd_ < 0) return false;
+
+            struct stat st{};
+            if (::fstat(fd_, &st) != 0) {
+               ::close(std::exchange(fd_, -1));
+               return false;
+            }
+
+            size_ = static_cast<size_t>(st.st_size);
+            tail_ = size_ % direct_io_alignment;
+            if (tail_ > 0) {
+               reserve(direct_io_alignment);
+               const auto result =
+                  ::pread(fd_, buffer_.get(), direct_io_alignment, static_cast<off_t>(size_ - tail_));
+               if (result != static_cast<ssize_t>(tail_)) {
+                  if (result >= 0) errno = EIO;
+                  ::close(std::exchange(fd_, -1));
+                  return false;
+               }
+            }
+            return true;
+         }
+
+         bool is_open() const { return fd_ >= 0; }
+
+         size_t size() const { return size_; }
+
+         // Throws std::system_error when the file cannot be written.
+         //
+         void append(const std::string_view data)
+         {
+            if (data.empty()) return;
+
+            const size_t bytes = tail_ + data.size();
+            const size_t padded = round_up(bytes);
+            reserve(padded);
+
+            char* buffer = buffer_.get();
+            std::memcpy(buffer + tail_, data.data(), data.size());
+            std::memset(buffer + bytes, 0, padded - bytes);
+
+            write_at(buffer, padded, size_ - tail_);
+            size_ += data.size();
+            if (padded != bytes and ::ftruncate(fd_, static_cast<off_t>(size_)) != 0) throw_error();
+
+            tail_ = bytes % direct_io_alignment;
+            std::memmove(buffer, buffer + bytes - tail_, tail_);
+         }
+
+         void close()
+         {
+            if (fd_ < 0) return;
+            ::close(std::exchange(fd_, -1));
+            size_ = 0;
+            tail_ = 0;
+         }
+
+         static constexpr size_t round_up(const size_t bytes)
+         {
+            return (bytes + direct_io_alignment - 1) / direct_io_alignment * direct_io_alignment;
+         }
+
+        private:
+         struct aligned_delete_t final
+         {
+            void operator()(char* ptr) const { ::operator delete(ptr, std::align_val_t{direct_io_alignment}); }
+         };
+
+         // Grows the aligned buffer to at least 'bytes', keeping the partial block at its start.
+         //
+         void reserve(const size_t bytes)
+         {
+            if (bytes <= capacity_) return;
+
+            const size_t capacity = std::max(bytes, capacity_ * 2);
+            std::unique_ptr<char, aligned_delete_t> buffer(
+               static_cast<char*>(::operator new(capacity, std::align_val_t{direct_io_alignment})));
+            if (tail_ > 0 and buffer_) std::memcpy(buffer.get(), buffer_.get(), tail_);
+
+            buffer_ = std::move(buffer);
+            capacity_ = capacity;
+         }
+
+         void write_at(const char* data, const size_t size, const size_t offset)
+         {
+            for (size_t written = 0; written < size;) {
+               const auto result = ::pwrite(fd_, data + written, size - written, static_cast<off_t>(offset + written));
+               if (result < 0 and errno == EINTR) continue;
+               if (result < 0) throw_error();
+               if (result == 0) {
+                  errno = EIO;
+                  throw_error();
+               }
+               written += static_cast<size_t>(result);
+            }
+         }
+
+         [[noreturn]] static void throw_error()
+         {
+            const std::error_code ec(errno, std::generic_category());
+            throw std::system_error(ec, std::format("Error writing log file (error code: {})!", ec.message()));
+         }
+
+         int fd_{-1};
+         size_t size_{}; ///< The size of the file, excluding padding.
+         size_t tail_{}; ///< The bytes of the file's partial last block, held at the start of 'buffer_'.
+         std::unique_ptr<char, aligned_delete_t> buffer_;
+         size_t capacity_{};
+      };
+#endif
+
+      // The files a log is split into: the log file, then 'stem_1.ext', 'stem_2.ext', ... next to
+      // it, where 'stem' is the log file's stem without a numeric suffix (see:
+      // 'get_next_available_filename'). The directory is listed once, to continue after the highest
+      // index in use, compressed files included; from then on the index is kept in memory, so
+      // splitting a log file does not probe the file system and there is no limit on the number of
+      // files. The files found are kept, oldest first, for 'notarius_opts_t::max_split_log_files'.
+      //
+      class log_file_sequence_t final
+      {
+        public:
+         // Returns the file following 'path', the log file or the last file returned.
+         //
+         std::string next(const std::string& path, const std::string_view default_extension)
+         {
+            if (path != last_) scan(path, default_extension);
+            last_ = std::format("{}/{}_{}{}", directory_, stem_, index_++, extension_);
+            return last_;
+         }
+
+         // Lists the directory again on the next call to 'next' (e.g., after removing a file it returned).
+         //
+         void forget() { last_.clear(); }
+
+         // Returns the files of the sequence already in the directory when it was last listed,
+         // other than the log file, in index order.
+         //
+         std::vector<std::string> take_existing() { return std::exchange(existing_, {}); }
+
+        private:
+         void scan(const std::string& path, const std::string_view default_extension)
+         {
+            const std::filesystem::path p = path;
+
+            directory_ = p.parent_path().string();
+            if (directory_.empty()) directory_ = std::filesystem::current_path().string();
+
+            extension_ = p.extension().string();
+            if (extension_.empty()) extension_ = default_extension;
+
+            stem_ = p.stem().string();
+            if (extension_ == ".lz4") { // e.g., 'app.log.lz4' continues as 'app_1.log.lz4'
+               const std::filesystem::path stem = stem_;
+               extension_ = stem.extension().string() + extension_;
+               stem_ = stem.stem().string();
+            }
+            const auto underscore = stem_.find_last_of('_');
+            if (underscore != std::string::npos and is_index(stem_.substr(underscore + 1))) stem_.erase(underscore);
+
+            index_ = 1;
+            std::vector<std::pair<uint64_t, std::string>> existing;
+            const std::string log_file_name = p.filename().string();
+            std::error_code ec;
+            for (std::filesystem::directory_iterator it(directory_, ec), end; not ec and it != end; it.increment(ec)) {
+               const std::string file_name = it->path().filename().string();
+               std::string name = file_name;
+               if (name.ends_with(".lz4")) name.resize(name.size() - 4); // see: 'compress_split_log_files'
+               if (name.size() <= stem_.size() + 1 + extension_.size() or not name.starts_with(stem_) or
+                   name[stem_.size()] != '_' or not name.ends_with(extension_)) {
+                  continue;
+               }
+
+               const std::string_view digits =
+                  std::string_view(name).substr(stem_.size() + 1, name.size() - stem_.size() - 1 - extension_.size());
+               uint64_t index{};
+               if (not is_index(digits)) continue;
+               if (std::from_chars(digits.data(), digits.data() + digits.size(), index).ec == std::errc{}) {
+                  index_ = std::max(index_, index + 1);
+                  if (file_name != log_file_name) existing.emplace_back(index, it->path().string());
+               }
+            }
+
+            std::sort(existing.begin(), existing.end());
+            existing_.clear();
+            for (auto& file : existing) existing_.emplace_back(std::move(file.second));
+         }
+
+         static bool is_index(const std::string_view digits)
+         {
+            return not digits.empty() and
+                   std::all_of(digits.begin(), digits.end(), [](const char c) { return c >= '0' and c <= '9'; });
+         }
+
+         std::string directory_;
+         std::string stem_;
+         std::string extension_;
+         uint64_t index_{1};
+         std::string last_; ///< The file 'next' returned last.
+         std::vector<std::string> existing_; ///< See: 'take_existing'.
+      };
+
+#if defined(NOTARIUS_HAS_FALLOCATE)
+      // Allocates the blocks for the first 'bytes' of the file at 'path' without changing its size
+      // (see: 'notarius_opts_t::preallocate_log_files'). Best effort: file systems that do not
+      // support it are left alone.
+      //
+      inline void preallocate_file(const std::string& path, const size_t bytes)
+      {
+         const int fd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+         if (fd < 0) return;
+         [[maybe_unused]] const int result = ::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(bytes));
+         ::close(fd);
+      }
+
+      // Releases the blocks allocated past the end of the file at 'path' by 'preallocate_file'.
+      //
+      inline void trim_file(const std::string& path)
+      {
+         const int fd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+         if (fd < 0) return;
+         struct stat st{};
+         if (::fstat(fd, &st) == 0) {
+            [[maybe_unused]] const int result = ::ftruncate(fd, st.st_size); // truncating drops the blocks past the end
+         }
+         ::close(fd);
+      }
+#endif
+
+#if defined(NOTARIUS_HAS_WRITEV)
+      // The stream buffers std::cout, std::cerr and std::clog start with. A stream still using its
+      // buffer has not been redirected (e.g., by 'std_stream_redirection_t'), so it writes to the
+      // file descriptor of stdout or stderr.
+      //
+      inline std::streambuf* const standard_cout_rdbuf = std::cout.rdbuf();
+      inline std::streambuf* const standard_cerr_rdbuf = std::cerr.rdbuf();
+      inline std::streambuf* const standard_clog_rdbuf = std::clog.rdbuf();
+
+      // Writes 'buffers' to 'fd' in order with writev(2), resuming after short writes.
+      // Returns false if a write fails.
+      //
+      template <size_t N>
+      bool write_gathered(const int fd, const std::array<std::string_view, N>& buffers)
+      {
+         std::array<iovec, N> iov{};
+         int count{};
+         for (const auto buffer : buffers) {
+            if (not buffer.empty()) iov[count++] = {const_cast<char*>(buffer.data()), buffer.size()};
+         }
+
+         for (iovec* next = iov.data(); count > 0;) {
+            const auto result = ::writev(fd, next, count);
+            if (result < 0 and errno == EINTR) continue;
+            if (result <= 0) return false;
+
+            for (auto written = static_cast<size_t>(result); written > 0;) {
+               if (written < next->iov_len) {
+                  next->iov_base = static_cast<char*>(next->iov_base) + written;
+                  next->iov_len -= written;
+                  break;
+               }
+               written -= next->iov_len;
+               ++next;
+               --count;
+            }
+         }
+         return true;
+      }
+#endif
+   }
+
+   /**
+    * @brief How often a format string was used (see: 'notarius_opts_t::count_format_uses').
+    */
+   struct format_count_t final
+   {
+      uint32_t id{}; ///< The id of the format string, stable for the life of the process.
+      std::string_view format{};
+      uint64_t count{};
+   };
+
+   /**
+    * @brief The format strings used so far, in the order of their ids, with the number of
+    *        times each was logged.
+    */
+   inline std::vector<format_count_t> format_counts()
+   {
+      auto& table = detail::format_table_t::instance();
+      const uint32_t size = table.size();
+
+      std::vector<format_count_t> counts;
+      counts.reserve(size);
+      for (uint32_t id = 0; id < size; ++id) {
+         auto& entry = table.entry(id);
+         counts.push_back({id, entry.text, entry.uses.load(std::memory_order_relaxed)});
+      }
+      return counts;
+   }
+
+   // The binary log format (see: 'notarius_opts_t::binary_format').
+   //
+   // A binary log is a sequence of records, each starting with a 'record_kind' byte. Values are
+   // written in the byte order of the machine that wrote them:
+   //
+   //   header:  "nlog", version (u16), 'layout_flags' (u8), subsecond digits (u8), pattern size (u16), pattern
+   //   format:  id (u32), size (u32), format string
+   //   message: id (u32), time (i64), thread (u32), level (u8), arguments size (u32), arguments
+   //   text:    size (u32), text
+   //
+   // A zero byte where a record starts begins the padding of a memory mapped log that was not
+   // closed (see: 'notarius_opts_t::memory_mapped_file'), which runs to the end of the log.
+   //
+   // Every log file starts with a header followed by the format strings logged so far, and a
+   // format string logged for the first time is defined ahead of its first message, so each file
+   // decodes on its own. The time of a message is in nanoseconds since the epoch, or 0 when it
+   // was not timestamped. An argument is an 'arg_type' byte followed by its value; a string is
+   // its size (u32) followed by its characters. Messages with arguments that cannot be encoded
+   // are written as text records, already laid out.
+   //
+   namespace nlog
+   {
+      inline constexpr std::string_view magic{"nlog"};
+      inline constexpr uint16_t version = 1;
+
+      enum class record_kind : uint8_t { padding, header, format, message, text };
+
+      // The order matches the alternatives of 'argument_t'.
+      enum class arg_type : uint8_t { i64, u64, f32, f64, boolean, character, string, pointer };
+
+      enum layout_flags : uint8_t { timestamps = 1, utc = 2, newline = 4 };
+
+      using argument_t = std::variant<int64_t, uint64_t, float, double, bool, char, std::string_view, const void*>;
+
+      // How messages are laid out as text; see the 'notarius_opts_t' fields of the same names.
+      //
+      struct layout_t final
+      {
+         std::string_view pattern{};
+         bool enable_timestamps{};
+         bool utc_timestamps{};
+         bool append_newline_when_missing{};
+         size_t timestamp_subsecond_digits{6};
+      };
+
+      template <typename T>
+      concept is_encodable = detail::is_deferred_string<T> || std::is_integral_v<std::decay_t<T>> ||
+                             std::is_same_v<std::decay_t<T>, float> || std::is_same_v<std::decay_t<T>, double> ||
+                             std::is_same_v<std::decay_t<T>, const void*> || std::is_same_v<std::decay_t<T>, void*> ||
+                             std::is_same_v<std::decay_t<T>, std::nullptr_t>;
+
+      template <class T>
+      void append_value(std::string& out, const T value)
+      {
+         out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+      }
+
+      template <is_encodable T>
+      void encode_argument(std::string& out, const T& arg)
+      {
+         using type = std::decay_t<T>;
+
+         const auto append = [&](const arg_type tag, const auto value) {
+            out.push_back(static_cast<char>(tag));
+            append_value(out, value);
+         };
+
+         if constexpr (detail::is_deferred_string<T>) {
+            const std::string_view str{arg};
+            append(arg_type::string, static_cast<uint32_t>(str.size()));
+            out.append(str);
+         }
+         else if constexpr (std::is_same_v<type, bool>)
+            append(arg_type::boolean, arg);
+         else if constexpr (std::is_same_v<type, char>)
+            append(arg_type::character, arg);
+         else if constexpr (std::is_same_v<type, float>)
+            append(arg_type::f32, arg);
+         else if constexpr (std::is_same_v<type, double>)
+            append(arg_type::f64, arg);
+         else if constexpr (std::is_signed_v<type>)
+            append(arg_type::i64, static_cast<int64_t>(arg));
+         else if constexpr (std::is_unsigned_v<type>)
+            append(arg_type::u64, static_cast<uint64_t>(arg));
+         else {
+            const void* pointer = arg;
+            append(arg_type::pointer, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(pointer)));
+         }
+      }
+
+      inline void append_header(std::string& out, const layout_t& layout)
+      {
+         uint8_t flags{};
+         if (layout.enable_timestamps) flags |= timestamps;
+         if (layout.utc_timestamps) flags |= utc;
+         if (layout.append_newline_when_missing) flags |= newline;
+
+         out.push_back(static_cast<char>(record_kind::header));
+         out.append(magic);
+         append_value(out, version);
+         append_value(out, flags);
+         append_value(out, static_cast<uint8_t>(std::min<size_t>(layout.timestamp_subsecond_digits, 9)));
+         append_value(out, static_cast<uint16_t>(layout.pattern.size()));
+         out.append(layout.pattern);
+      }
+
+      inline void append_format(std::string& out, const uint32_t id, const std::string_view fmt)
+      {
+         out.push_back(static_cast<char>(record_kind::format));
+         append_value(out, id);
+         append_value(out, static_cast<uint32_t>(fmt.size()));
+         out.append(fmt);
+      }
+
+      // Appends the start of a message record; 'arguments' are already encoded.
+      //
+      inline void append_message(std::string& out, const uint32_t id, const int64_t time, const uint32_t thread,
+                                 const log_level level, const std::string_view arguments)
+      {
+         out.push_back(static_cast<char>(record_kind::message));
+         append_value(out, id);
+         append_value(out, time);
+         append_value(out, thread);
+         append_value(out, static_cast<uint8_t>(level));
+         append_value(out, static_cast<uint32_t>(arguments.size()));
+         out.append(arguments);
+      }
+
+      inline void append_text(std::string& out, const std::string_view text)
+      {
+         out.push_back(static_cast<char>(record_kind::text));
+         append_value(out, static_cast<uint32_t>(text.size()));
+         out.append(text);
+      }
+
+      template <class T>
+      T read_value(std::string_view& in)
+      {
+         if (in.size() < sizeof(T)) throw std::runtime_error("binary log: truncated record");
+         T value;
+         std::memcpy(&value, in.data(), sizeof(T));
+         in.remove_prefix(sizeof(T));
+         return value;
+      }
+
+      inline std::string_view read_bytes(std::string_view& in, const size_t size)
+      {
+         if (in.size() < size) throw std::runtime_error("binary log: truncated record");
+         const auto bytes = in.substr(0, size);
+         in.remove_prefix(size);
+         return bytes;
+      }
+
+      inline argument_t decode_argument(std::string_view& in)
+      {
+         switch (static_cast<arg_type>(read_value<uint8_t>(in))) {
+         case arg_type::i64:
+            return read_value<int64_t>(in);
+         case arg_type::u64:
+            return read_value<uint64_t>(in);
+         case arg_type::f32:
+            return read_value<float>(in);
+         case arg_type::f64:
+            return read_value<double>(in);
+         case arg_type::boolean:
+            return read_value<bool>(in);
+         case arg_type::character:
+            return read_value<char>(in);
+         case arg_type::string:
+            return read_bytes(in, read_value<uint32_t>(in));
+         case arg_type::pointer:
+            return reinterpret_cast<const void*>(static_cast<uintptr_t>(read_value<uint64_t>(in)));
+         default:
+            throw std::runtime_error("binary log: unknown argument type");
+         }
+      }
+
+      inline void decode_arguments(std::string_view in, std::vector<argument_t>& args)
+      {
+         args.clear();
+         while (not in.empty()) args.push_back(decode_argument(in));
+      }
+
+      // Formats 'fmt' with decoded arguments as std::format would, one replacement field at a time.
+      //
+      inline void format_arguments(std::string& out, const std::string_view fmt, const std::span<const argument_t> args)
+      {
+         size_t next_arg{};
+         const auto arg_at = [&](const std::string_view index) -> const argument_t& {
+            size_t i = next_arg++;
+            if (not index.empty()) {
+               const auto result = std::from_chars(index.data(), index.data() + index.size(), i);
+               if (result.ec != std::errc{}) throw std::runtime_error("binary log: invalid format string");
+            }
+            if (i >= args.size()) throw std::runtime_error("binary log: missing format argument");
+            return args[i];
+         };
+
+         std::string field_fmt;
+
+         for (size_t i = 0; i < fmt.size(); ++i) {
+            if (fmt[i] == '}') {
+               if (i + 1 < fmt.size() and fmt[i + 1] == '}') ++i;
+               out.push_back('}');
+               continue;
+            }
+            if (fmt[i] != '{') {
+               out.push_back(fmt[i]);
+               continue;
+            }
+            if (i + 1 < fmt.size() and fmt[i + 1] == '{') {
+               out.push_back('{');
+               ++i;
+               continue;
+            }
+
+            // A replacement field "{index:spec}", where the spec may hold nested "{index}" fields.
+            size_t end = i + 1;
+            for (int depth = 1; end < fmt.size(); ++end) {
+               if (fmt[end] == '{') ++depth;
+               if (fmt[end] == '}' and --depth == 0) break;
+            }
+            if (end == fmt.size()) throw std::runtime_error("binary log: invalid format string");
+
+            const auto field = fmt.substr(i + 1, end - i - 1);
+            const auto colon = field.find(':');
+            const auto spec = colon == std::string_view::npos ? std::string_view{} : field.substr(colon + 1);
+            const argument_t& arg = arg_at(field.substr(0, colon));
+            i = end;
+
+            field_fmt.assign("{:");
+            for (size_t j = 0; j < spec.size(); ++j) {
+               if (spec[j] != '{') {
+                  field_fmt.push_back(spec[j]);
+                  continue;
+               }
+               const auto close = spec.find('}', j);
+               if (close == std::string_view::npos) throw std::runtime_error("binary log: invalid format string");
+               std::visit([&](const auto& value) { std::format_to(std::back_inserter(field_fmt), "{}", value); },
+                          arg_at(spec.substr(j + 1, close - j - 1)));
+               j = close;
+            }
+            field_fmt.push_back('}');
+
+            std::visit(
+               [&](const auto& value) {
+                  std::vformat_to(std::back_inserter(out), field_fmt, std::make_format_args(value));
+               },
+               arg);
+         }
+      }
+
+      // Renders a binary log as the text notarius writes without 'binary_format'. Timestamps
+      // are rendered in the local time zone of the caller unless 'utc_timestamps' was set.
+      // Throws std::runtime_error when the log is malformed.
+      //
+      inline void decode(std::string_view in, std::string& out)
+      {
+         layout_t layout;
+         detail::parsed_pattern_t parsed;
+         bool has_header{};
+         std::vector<std::string_view> formats;
+         std::vector<bool> defined;
+         std::vector<argument_t> args;
+
+         while (not in.empty()) {
+            switch (static_cast<record_kind>(read_value<uint8_t>(in))) {
+            case record_kind::header: {
+               if (read_bytes(in, magic.size()) != magic) throw std::runtime_error("binary log: bad header");
+               if (read_value<uint16_t>(in) != version) throw std::runtime_error("binary log: unsupported version");
+               const auto flags = read_value<uint8_t>(in);
+               layout.enable_timestamps = flags & timestamps;
+               layout.utc_timestamps = flags & utc;
+               layout.append_newline_when_missing = flags & newline;
+               layout.timestamp_subsecond_digits = read_value<uint8_t>(in);
+               layout.pattern = read_bytes(in, read_value<uint16_t>(in));
+
+               if (layout.pattern.size() > log_pattern_t::max_size) throw std::runtime_error("binary log: bad pattern");
+               log_pattern_t pattern;
+               std::copy_n(layout.pattern.data(), layout.pattern.size(), pattern.value.data());
+               pattern.size = layout.pattern.size();
+               try {
+                  parsed = detail::parse_pattern(pattern);
+               }
+               catch (const char* error) {
+                  throw std::runtime_error(std::format("binary log: {}", error));
+               }
+
+               formats.clear();
+               defined.clear();
+               has_header = true;
+               break;
+            }
+            case record_kind::format: {
+               const auto id = read_value<uint32_t>(in);
+               const auto fmt = read_bytes(in, read_value<uint32_t>(in));
+               if (id >= formats.size()) {
+                  formats.resize(id + 1);
+                  defined.resize(id + 1);
+               }
+               formats[id] = fmt;
+               defined[id] = true;
+               break;
+            }
+            case record_kind::message: {
+               const auto id = read_value<uint32_t>(in);
+               const auto time = read_value<int64_t>(in);
+               const auto thread = read_value<uint32_t>(in);
+               const auto level = static_cast<log_level>(read_value<uint8_t>(in));
+               decode_arguments(read_bytes(in, read_value<uint32_t>(in)), args);
+
+               if (not has_header) throw std::runtime_error("binary log: missing header");
+               if (id >= defined.size() or not defined[id]) throw std::runtime_error("binary log: undefined format");
+               if (level >= log_level::ignore) throw std::runtime_error("binary log: invalid level");
+
+               const auto write_message = [&](std::string& o) { format_arguments(o, formats[id], args); };
+
+               const size_t begin = out.size();
+               if (parsed.size > 0) {
+                  const detail::pattern_context_t context{time, layout.utc_timestamps, level, thread};
+                  detail::emit_pattern(out, layout.pattern, parsed, context, write_message);
+               }
+               else {
+                  if (layout.enable_timestamps) {
+                     detail::append_timestamp(out, time, layout.utc_timestamps, layout.timestamp_subsecond_digits);
+                  }
+                  if (log_level::none != level) out.append(to_string(level)).append(": ");
+                  write_message(out);
+               }
+
+               if (layout.append_newline_when_missing) {
+                  if (out.size() > begin and '\n' != out.back()) {
+                     out.append("\n");
+                  }
+               }
+               break;
+            }
+            case record_kind::text:
+               out.append(read_bytes(in, read_value<uint32_t>(in)));
+               break;
+            case record_kind::padding:
+               // The zero bytes at the end of a memory mapped log that was not closed.
+               if (in.find_first_not_of('\0') != std::string_view::npos)
+                  throw std::runtime_error("binary log: unknown record");
+               return;
+            default:
+               throw std::runtime_error("binary log: unknown record");
+            }
+         }
+      }
+   }
+
+   // LZ4 frames (see: https://github.com/lz4/lz4/blob/dev/doc/lz4_Frame_format.md), used to compress
+   // log files (see: 'notarius_opts_t::compress_log_files' and 'compress_split_log_files'). 'compress'
+   // writes a frame of independent 4 MB blocks, which the 'lz4' tool reads; 'decompress' reads the
+   // frames the 'lz4' tool writes as well. Values are little-endian.
+   //
+   namespace lz4
+   {
+      inline constexpr uint32_t magic = 0x184D2204;
+      inline constexpr size_t max_block_size = 4 << 20;
+
+      inline uint32_t read_u32(const char* data)
+      {
+         const auto* bytes = reinterpret_cast<const uint8_t*>(data);
+         return uint32_t(bytes[0]) | uint32_t(bytes[1]) << 8 | uint32_t(bytes[2]) << 16 | uint32_t(bytes[3]) << 24;
+      }
+
+      inline void append_u32(std::string& out, const uint32_t value)
+      {
+         for (int shift = 0; shift < 32; shift += 8) out.push_back(static_cast<char>(value >> shift));
+      }
+
+      // The xxHash32 of 'data' (see: https://github.com/Cyan4973/xxHash), which checksums LZ4 frames.
+      //
+      inline uint32_t xxh32(const std::string_view data, const uint32_t seed = 0)
+      {
+         constexpr uint32_t p1 = 2654435761U, p2 = 2246822519U, p3 = 3266489917U, p4 = 668265263U, p5 = 374761393U;
+
+         const auto round = [](uint32_t acc, const uint32_t input) { return std::rotl(acc + input * p2, 13) * p1; };
+
+         size_t i{};
+         uint32_t hash{};
+         if (data.size() >= 16) {
+            uint32_t v1 = seed + p1 + p2, v2 = seed + p2, v3 = seed, v4 = seed - p1;
+            for (; i + 16 <= data.size(); i += 16) {
+               v1 = round(v1, read_u32(data.data() + i));
+               v2 = round(v2, read_u32(data.data() + i + 4));
+               v3 = round(v3, read_u32(data.data() + i + 8));
+               v4 = round(v4, read_u32(data.data() + i + 12));
+            }
+            hash = std::rotl(v1, 1) + std::rotl(v2, 7) + std::rotl(v3, 12) + std::rotl(v4, 18);
+         }
+         else {
+            hash = seed + p5;
+         }
+
+         hash += static_cast<uint32_t>(data.size());
+         for (; i + 4 <= data.size(); i += 4) hash = std::rotl(hash + read_u32(data.data() + i) * p3, 17) * p4;
+         for (; i < data.size(); ++i) hash = std::rotl(hash + static_cast<uint8_t>(data[i]) * p5, 11) * p1;
+
+         hash ^= hash >> 15;
+         hash *= p2;
+         hash ^= hash >> 13;
+         hash *= p3;
+         hash ^= hash >> 16;
+         return hash;
+      }
+
+      // Appends the LZ4 block compressing 'in' to 'out'. Matches are found greedily through a hash
+      // table of the last position of each 4 byte sequence, skipping ahead faster the longer no
+      // match is found, so incompressible input is passed over quickly.
+      //
+      inline void compress_block(const std::string_view in, std::string& out)
+      {
+         constexpr size_t min_match = 4;
+         constexpr size_t last_literals = 5; // a block ends with at least 5 literals,
+         constexpr size_t match_start_limit = 12; // and its last match starts 12 bytes before its end
+         constexpr int hash_bits = 16;
+
+         const auto sequence_at = [&](const size_t pos) { return read_u32(in.data() + pos); };
+         const auto hash = [](const uint32_t sequence) { return (sequence * 2654435761U) >> (32 - hash_bits); };
+
+         const auto append_length = [&](size_t length) {
+            for (; length >= 255; length -= 255) out.push_back(static_cast<char>(255));
+            out.push_back(static_cast<char>(length));
+         };
+
+         // The token, the literals 'in[begin, end)', and the length of the match that follows them.
+         const auto append_literals = [&](const size_t begin, const size_t end, const size_t match_length) {
+            const size_t literals = end - begin;
+            const size_t match_code = match_length > 0 ? match_length - min_match : 0;
+            out.push_back(static_cast<char>(std::min<size_t>(literals, 15) << 4 | std::min<size_t>(match_code, 15)));
+            if (literals >= 15) append_length(literals - 15);
+            out.append(in.data() + begin, literals);
+         };
+
+         size_t anchor{}; // where the pending literals start
+         if (in.size() > match_start_limit) {
+            std::vector<uint32_t> table(size_t(1) << hash_bits);
+            const size_t last_match_start = in.size() - match_start_limit;
+            const size_t match_end_limit = in.size() - last_literals;
+
+            size_t pos{}, misses{};
+            while (pos <= last_match_start) {
+               const uint32_t sequence = sequence_at(pos);
+               auto& entry = table[hash(sequence)];
+               const size_t candidate = entry;
+               entry = static_cast<uint32_t>(pos);
+
+               if (candidate >= pos or pos - candidate > 65535 or sequence_at(candidate) != sequence) {
+                  pos += 1 + (misses++ >> 6);
+                  continue;
+               }
+
+               size_t start = pos, from = candidate, length = min_match;
+               while (pos + length < match_end_limit and in[candidate + length] == in[pos + length]) ++length;
+               while (start > anchor and from > 0 and in[start - 1] == in[from - 1]) {
+                  --start;
+                  --from;
+                  ++length;
+               }
+
+               append_literals(anchor, start, length);
+               const size_t offset = start - from;
+               out.push_back(static_cast<char>(offset & 0xFF));
+               out.push_back(static_cast<char>(offset >> 8));
+               if (length - min_match >= 15) append_length(length - min_match - 15);
+
+               anchor = pos = start + length;
+               misses = 0;
+               table[hash(sequence_at(pos - 2))] = static_cast<uint32_t>(pos - 2);
+            }
+         }
+
+         append_literals(anchor, in.size(), 0);
+      }
+
+      // Appends what the LZ4 block 'in' decompresses to to 'out'. Matches may reach back into what
+      // 'out' held before (the previous blocks of a frame with dependent blocks). Throws
+      // std::runtime_error if the block is corrupt or decompresses to more than 'max_size' bytes.
+      //
+      inline void decompress_block(const std::string_view in, std::string& out, const size_t max_size)
+      {
+         const auto corrupt = [] { throw std::runtime_error("lz4: corrupt block"); };
+
+         size_t pos{};
+         const auto read_length = [&](size_t length) {
+            if (length != 15) return length;
+            for (uint8_t byte = 255; byte == 255; length += byte) {
+               if (pos == in.size()) corrupt();
+               byte = static_cast<uint8_t>(in[pos++]);
+            }
+            return length;
+         };
+
+         const size_t limit = out.size() + max_size;
+         while (pos < in.size()) {
+            const auto token = static_cast<uint8_t>(in[pos++]);
+
+            const size_t literals = read_length(token >> 4);
+            if (literals > in.size() - pos or literals > limit - out.size()) corrupt();
+            out.append(in.data() + pos, literals);
+            pos += literals;
+            if (pos == in.size()) break; // the last sequence has no match
+
+            if (in.size() - pos < 2) corrupt();
+            const size_t offset = static_cast<uint8_t>(in[pos]) | size_t(static_cast<uint8_t>(in[pos + 1])) << 8;
+            pos += 2;
+            const size_t length = read_length(token & 15) + 4;
+            if (offset == 0 or offset > out.size() or length > limit - out.size()) corrupt();
+
+            const size_t size = out.size();
+            out.resize(size + length);
+            char* data = out.data();
+            if (offset >= length) {
+               std::memcpy(data + size, data + size - offset, length);
+            }
+            else { // the match repeats its last 'offset' bytes
+               for (size_t i = 0; i < length; ++i) data[size + i] = data[size - offset + i];
+            }
+         }
+      }
+
+      // The header of a frame of independent 4 MB blocks without checksums.
+      //
+      inline void append_frame_header(std::string& out)
+      {
+         const size_t begin = out.size();
+         append_u32(out, magic);
+         out.push_back(0x60); // version 1, independent blocks
+         out.push_back(0x70); // 4 MB blocks
+         out.push_back(static_cast<char>(xxh32(std::string_view(out).substr(begin + 4, 2)) >> 8));
+      }
+
+      // Appends a frame block holding 'in' (at most 'max_block_size' bytes): its size followed by the
+      // compressed block, or by 'in' itself when it does not compress.
+      //
+      inline void append_frame_block(const std::string_view in, std::string& out)
+      {
+         const size_t begin = out.size();
+         append_u32(out, 0);
+         compress_block(in, out);
+
+         auto size = static_cast<uint32_t>(out.size() - begin - 4);
+         if (size >= in.size()) {
+            out.replace(begin + 4, std::string::npos, in);
+            size = static_cast<uint32_t>(in.size()) | 0x80000000; // stored uncompressed
+         }
+         for (int i = 0; i < 4; ++i) out[begin + i] = static_cast<char>(size >> (8 * i));
+      }
+
+      // Appends the LZ4 frame compressing 'in' to 'out'.
+      //
+      inline void compress(const std::string_view in, std::string& out)
+      {
+         append_frame_header(out);
+         for (size_t pos = 0; pos < in.size(); pos += max_block_size) {
+            append_frame_block(in.substr(pos, max_block_size), out);
+         }
+         append_u32(out, 0); // the end mark
+      }
+
+      // Writes 'input' to 'output' as an LZ4 frame.
+      //
+      inline void compress(std::istream& input, std::ostream& output)
+      {
+         std::string block(max_block_size, '\0'), frame;
+         append_frame_header(frame);
+
+         while (input) {
+            input.read(block.data(), max_block_size);
+            const auto size = static_cast<size_t>(input.gcount());
+            if (size == 0) break;
+
+            append_frame_block(std::string_view(block.data(), size), frame);
+            output.write(frame.data(), frame.size());
+            frame.clear();
+         }
+
+         append_u32(frame, 0); // the end mark
+         output.write(frame.data(), frame.size());
+      }
+
+      // Writes what the LZ4 frames read from 'input' decompress to to 'output', skipping skippable
+      // frames. Header and block checksums are verified; content checksums are not. Zero bytes
+      // where a frame starts end the input: the padding of a memory mapped log that was not closed
+      // (see: 'notarius_opts_t::memory_mapped_file'). Throws std::runtime_error if the input is not
+      // LZ4 or is corrupt; what was decompressed before is written.
+      //
+      inline void decompress(std::istream& input, std::ostream& output)
+      {
+         const auto fail = [](const char* what) { throw std::runtime_error(std::format("lz4: {}", what)); };
+
+         char bytes[8];
+         const auto read = [&](char* data, const size_t size) {
+            input.read(data, size);
+            if (static_cast<size_t>(input.gcount()) != size) fail("truncated frame");
+         };
+         const auto read_u32_from_input = [&] {
+            read(bytes, 4);
+            return read_u32(bytes);
+         };
+
+         std::string window, block, descriptor;
+         while (input.peek() != std::char_traits<char>::eof()) {
+            const uint32_t frame_magic = read_u32_from_input();
+            if (frame_magic == 0) return;
+            if ((frame_magic & 0xFFFFFFF0) == 0x184D2A50) { // a skippable frame
+               input.ignore(read_u32_from_input());
+               continue;
+            }
+            if (frame_magic != magic) fail("not an lz4 frame");
+
+            descriptor.resize(2);
+            read(descriptor.data(), 2);
+            const auto flags = static_cast<uint8_t>(descriptor[0]);
+            if ((flags >> 6) != 1) fail("unsupported frame version");
+            const bool independent = flags & 0x20, block_checksums = flags & 0x10, content_checksum = flags & 0x04;
+
+            // The content size and the dictionary id are read only for the header checksum.
+            const size_t optional_bytes = (flags & 0x08 ? 8 : 0) + (flags & 0x01 ? 4 : 0);
+            read(bytes, optional_bytes);
+            descriptor.append(bytes, optional_bytes);
+
+            read(bytes, 1);
+            if (static_cast<uint8_t>(bytes[0]) != static_cast<uint8_t>(xxh32(descriptor) >> 8)) {
+               fail("header checksum mismatch");
+            }
+
+            const int block_size_id = (static_cast<uint8_t>(descriptor[1]) >> 4) & 7;
+            if (block_size_id < 4) fail("invalid block size");
+            const size_t max_size = size_t(1) << (8 + 2 * block_size_id);
+
+            window.clear();
+            while (true) {
+               uint32_t size = read_u32_from_input();
+               if (size == 0) break; // the end mark
+
+               const bool stored = size & 0x80000000;
+               size &= 0x7FFFFFFF;
+               if (size > max_size) fail("invalid block size");
+
+               block.resize(size);
+               read(block.data(), size);
+               if (block_checksums and read_u32_from_input() != xxh32(block)) fail("block checksum mismatch");
+
+               const size_t begin = window.size();
+               if (stored)
+                  window.append(block);
+               else
+                  decompress_block(block, window, max_size);
+               output.write(window.data() + begin, window.size() - begin);
+
+               // Dependent blocks may refer to the 64 KB preceding them.
+               if (independent)
+                  window.clear();
+               else if (window.size() > 65536)
+                  window.erase(0, window.size() - 65536);
+            }
+
+            if (content_checksum) read(bytes, 4);
+         }
+      }
+
+      // Compresses the file at 'path' to 'path' + ".lz4" and removes 'path'. The compressed file
+      // is written under a temporary name and renamed once complete. Throws std::runtime_error or
+      // std::filesystem::filesystem_error on failure, leaving 'path' in place.
+      //
+      inline void compress_file(const std::string& path)
+      {
+         const std::string compressed_path = path + ".lz4";
+         const std::string temporary_path = compressed_path + ".tmp";
+
+         {
+            std::ifstream input(path, std::ios_base::binary);
+            if (not input.is_open()) throw std::runtime_error(std::format("lz4: cannot open '{}'", path));
+            std::ofstream output(temporary_path, std::ios_base::binary | std::ios_base::trunc);
+            if (not output.is_open()) throw std::runtime_error(std::format("lz4: cannot create '{}'", temporary_path));
+
+            compress(input, output);
+            output.flush();
+            if (input.bad() or not output) {
+               output.close();
+               std::filesystem::remove(temporary_path);
+               throw std::runtime_error(std::format("lz4: error compressing '{}'", path));
+            }
+         }
+
+         std::filesystem::rename(temporary_path, compressed_path);
+         std::filesystem::remove(path);
+      }
+   }
+
+   struct output_as_json_t
+   {
+      std::unordered_map<std::string, std::vector<std::string>> data;
+   };
+
+   // A sink receives every message logged as text, with its level, in addition to the log file
+   // and the standard outputs enabled in 'notarius_opts_t'. Sinks are listed as template
+   // arguments of 'notarius_t', which owns one default-constructed instance of each and calls
+   // them in order, without virtual calls or runtime checks. Calls are serialized by the logger.
+   // A sink may also provide 'flush()', called when the logger flushes.
+   //
+   template <typename T>
+   concept is_log_sink =
+      std::default_initializable<T> and requires(T& sink, const std::string_view msg, const log_level level) {
+         sink.write(msg, level);
+      };
+
+   // Writes messages of 'MinLevel' and above to std::cout.
+   //
+   template <log_level MinLevel = log_level::none>
+   struct stdout_sink_t final
+   {
+      void write(const std::string_view msg, const log_level level)
+      {
+         if (level >= MinLevel) std::cout.write(msg.data(), msg.size());
+      }
+
+      void flush() { std::cout.flush(); }
+   };
+
+   // Writes messages of 'MinLevel' and above to std::cerr.
+   //
+   template <log_level MinLevel = log_level::error>
+   struct stderr_sink_t final
+   {
+      void write(const std::string_view msg, const log_level level)
+      {
+         if (level >= MinLevel) std::cerr.write(msg.data(), msg.size());
+      }
+
+      void flush() { std::cerr.flush(); }
+   };
+
+   // Appends messages to the file at 'Path', e.g., a second log file with a different
+   // 'MinLevel' than the logger's own.
+   //
+   template <string_literal Path, log_level MinLevel = log_level::none>
+   struct file_sink_t final
+   {
+      file_sink_t() : stream_(std::string(chars<Path>), std::ios_base::app | std::ios_base::binary)
+      {
+         if (not stream_.is_open()) {
+            std::error_code ec = std::make_error_code(std::errc::io_error);
+            throw std::system_error(ec, std::format("Error opening sink file '{}'!", chars<Path>));
+         }
+      }
+
+      void write(const std::string_view msg, const log_level level)
+      {
+         if (level >= MinLevel) stream_.write(msg.data(), msg.size());
+      }
+
+      void flush() { stream_.flush(); }
+
+     private:
+      std::ofstream stream_;
+   };
+
+   // Calls 'Callback(msg, level)' for each message. Unlike 'notarius_t::forward_to', the
+   // callback is fixed at compile time and called on the logging thread.
+   //
+   template <auto Callback>
+      requires std::invocable<decltype(Callback), std::string_view, log_level>
+   struct callback_sink_t final
+   {
+      void write(const std::string_view msg, const log_level level) { std::invoke(Callback, msg, level); }
+   };
+
+   // Keeps the last 'Capacity' messages in memory, e.g., to dump them when a failure is detected.
+   // Read it through 'notarius_t::sink' while no thread is logging.
+   //
+   template <size_t Capacity>
+      requires(Capacity > 0)
+   struct ring_sink_t final
+   {
+      void write(const std::string_view msg, const log_level) { messages_[written_++ % Capacity].assign(msg); }
+
+      size_t size() const { return std::min(written_, Capacity); }
+
+      // The messages kept, oldest first.
+      //
+      std::vector<std::string> messages() const
+      {
+         std::vector<std::string> result;
+         result.reserve(size());
+         for (size_t i = written_ - size(); i < written_; ++i) result.emplace_back(messages_[i % Capacity]);
+         return result;
+      }
+
+      void clear() { written_ = 0; }
+
+     private:
+      std::array<std::string, Capacity> messages_{};
+      size_t written_{};
+   };
+
+   /**
+      @brief A logger class for writing log messages to a file.
+      @tparam LogFileNameOrPath The file or path name of the logger. If not provided, it defaults to 'notatarius'.
+      @tparam Options The options for configuring the logger. Defaults to an empty notarius_opts_t struct.
+      @tparam Sinks Further outputs for the messages logged as text (see: 'is_log_sink').
+   */
+   template <slx::string_literal LogFileNameOrPath, notarius_opts_t Options, is_log_sink... Sinks>
+   struct notarius_t final
+   {
+     private:
+      static constexpr std::string_view default_logger_name_or_path{LogFileNameOrPath};
+
+      mutable std::string log_output_file_path_{get_log_file_path(default_logger_name_or_path.data())};
+
+      std::shared_ptr<std::shared_mutex> mutex_ = std::make_shared<std::shared_mutex>();
+
+      // The logging store.
+      // using std::string as the store is slightly faster:
+      // std::deque<std::string> logging_store_;
+      //
+      std::string logging_store_;
+      std::string cout_store_;
+      std::string cerr_store_;
+      std::string clog_store_;
+
+      static constexpr bool has_sinks = sizeof...(Sinks) > 0;
+      std::tuple<Sinks...> sinks_; // see: 'is_log_sink'
+
+      std::atomic_bool reserve_once{true};
+
+      void reserve_store_capacities()
+      {
+         if (logging_store_.capacity() < options_.split_log_file_at_size_bytes) {
+            logging_store_.reserve(options_.split_log_file_at_size_bytes);
+         }
+
+         if (cout_store_.capacity() < options_.flush_to_std_outputs_at_bytes) {
+            cout_store_.reserve(options_.flush_to_std_outputs_at_bytes);
+         }
+
+         if (cerr_store_.capacity() < options_.flush_to_std_outputs_at_bytes) {
+            cerr_store_.reserve(options_.flush_to_std_outputs_at_bytes);
+         }
+
+         if (cout_store_.capacity() < options_.flush_to_std_outputs_at_bytes) {
+            cerr_store_.reserve(options_.flush_to_std_outputs_at_bytes);
+         }
+      }
+
+      std::ofstream log_output_stream_;
+#if defined(NOTARIUS_HAS_MMAP)
+      detail::mapped_file_t mapped_file_; // used instead of 'log_output_stream_' with 'memory_mapped_file'
+#endif
+#if defined(NOTARIUS_HAS_IO_URING)
+      detail::uring_file_t uring_file_; // used instead of 'log_output_stream_' with 'io_uring_file'
+#endif
+#if defined(NOTARIUS_HAS_O_DIRECT)
+      detail::direct_file_t direct_file_; // used instead of 'log_output_stream_' with 'direct_io_file'
+#endif
+
+      // The logging store is double-buffered: a full 'logging_store_' is swapped into
+      // 'flush_store_' with the lock held, and written to the log file by the same thread
+      // after the lock has been released, while other threads fill the emptied store.
+      //
+      // 'io_mutex_' guards 'flush_store_', the log file, 'log_file_bytes_' and
+      // changes to 'log_output_file_path_'. It is only ever acquired after 'mutex_'.
+      //
+      std::string flush_store_;
+      std::string compressed_store_; // 'flush_store_' as an LZ4 frame (see: 'compress_log_files')
+      std::mutex io_mutex_;
+      std::unique_lock<std::mutex> io_handoff_{io_mutex_, std::defer_lock}; // owned while 'flush_store_' is pending
+      size_t log_file_bytes_{}; // bytes in the current log file
+      bool log_file_preallocated_{}; // see: 'notarius_opts_t::preallocate_log_files'
+      std::chrono::steady_clock::time_point log_file_opened_at_{}; // see: 'split_log_file_interval_seconds'
+
+      // Splitting the log file (see: 'split_log_file'). With the std::ofstream sink, the next file
+      // is opened ahead of the split into 'next_log_output_stream_'.
+      //
+      detail::log_file_sequence_t log_file_sequence_;
+      std::ofstream next_log_output_stream_;
+      std::string next_log_file_path_;
+      size_t next_log_file_bytes_{};
+
+      // Toggle writing to the ostream on/logging_off at some logging point in your code.
+      //
+      std::atomic_bool toggle_immediate_mode_ = {false};
+
+      // Binary logs (see: 'notarius_opts_t::binary_format'). Messages refer to format strings by
+      // their id in the 'detail::format_table_t'; 'formats_' holds the format records of those
+      // this logger has written, which are repeated after the header of each log file.
+      // 'defined_formats_' is guarded by 'mutex_', 'formats_' by 'formats_mutex_'.
+      //
+      std::vector<bool> defined_formats_;
+      std::string formats_;
+      std::mutex formats_mutex_;
+      std::atomic<log_level> min_level_{Options.min_level}; // see: 'set_min_level'
+
+      // 'Options' as adjusted for the log file mode in use.
+      //
+      static constexpr notarius_opts_t runtime_options()
+      {
+         notarius_opts_t options = Options;
+#if defined(NOTARIUS_HAS_O_DIRECT)
+         if (options.direct_io_file) {
+            options.flush_to_log_at_bytes = detail::direct_file_t::round_up(options.flush_to_log_at_bytes);
+            options.split_log_file_at_size_bytes =
+               detail::direct_file_t::round_up(options.split_log_file_at_size_bytes);
+         }
+#endif
+         return options;
+      }
+
+      notarius_opts_t options_{runtime_options()};
+
+      std::shared_ptr<std::shared_mutex> get_mutex() { return mutex_; }
+
+      // Method to get a unique lock for exclusive write access
+      std::unique_lock<std::shared_mutex> get_exclusive_write_lock()
+      {
+         return std::unique_lock<std::shared_mutex>(*mutex_);
+      }
+
+      // Method to get a shared lock for shared read access
+      std::shared_lock<std::shared_mutex> get_shared_read_lock() const
+      {
+         return std::shared_lock<std::shared_mutex>(*mutex_);
+      }
+
+      // Method to try acquiring an exclusive write lock with retries
+      std::optional<std::unique_lock<std::shared_mutex>> try_exclusive_write_lock(const int max_attempts = 3,
+                                                                                  const int delay_ms = 10)
+      {
+         std::unique_lock<std::shared_mutex> cs(*mutex_, std::try_to_lock);
+
+         for (int attempts = 0; !cs.owns_lock() && attempts < max_attempts; ++attempts) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+            if (cs.try_lock()) break;
+         }
+
+         if (cs.owns_lock()) {
+            return std::optional<std::unique_lock<std::shared_mutex>>(std::move(cs));
+         }
+
+         return std::nullopt;
+      }
+
+      // A delegate to forward log messages to (see: 'notarius_t::forward_to'). It is
+      // called on 'forward_thread_' with batches of messages; 'forward_to_mutex_' is
+      // held while it runs.
+      //
+      std::function<void(std::span<const std::string_view>)> forward_to_;
+      std::mutex forward_to_mutex_;
+      std::atomic<bool> forwarding_{false};
+
+      // Forwarded messages are appended to 'forward_queue_', with the end offset of
+      // each message in 'forward_ends_'.
+      //
+      std::string forward_queue_;
+      std::vector<size_t> forward_ends_;
+      std::mutex forward_mutex_;
+      std::condition_variable_any forward_cv_; // wakes the forwarding thread
+      std::condition_variable forward_space_cv_; // wakes threads waiting for queue space
+      std::condition_variable forwarded_cv_; // wakes threads waiting in 'drain_forward_queue'
+      size_t forward_enqueued_{};
+      size_t forward_delivered_{};
+      std::once_flag forward_once_;
+      std::jthread forward_thread_;
+
+      // Async mode: producers append records (see: 'detail::record_header_t') to
+      // 'async_queue_'; the writer thread swaps the queue out and commits the
+      // records to the stores.
+      //
+      std::string async_queue_;
+      std::mutex queue_mutex_;
+      std::condition_variable_any queue_cv_; // wakes the writer thread
+      std::condition_variable space_cv_; // wakes producers waiting for queue space
+      std::condition_variable drained_cv_; // wakes threads waiting in 'drain_async_queue'
+      size_t enqueued_records_{};
+      size_t committed_records_{};
+      std::atomic<uint64_t> dropped_messages_{};
+      uint64_t reported_drops_{}; // drops reported in the log by the writer thread
+      uint64_t committed_sequence_{}; // every staged record below this has been committed
+      size_t drain_waiters_{};
+      std::once_flag writer_once_;
+      std::jthread writer_thread_;
+
+      // Background handling of split log files: compression (see:
+      // 'notarius_opts_t::compress_split_log_files') and retention (see:
+      // 'notarius_opts_t::max_split_log_files').
+      //
+      struct retired_log_file_t final
+      {
+         std::string path;
+         bool compress{};
+      };
+      std::deque<retired_log_file_t> retire_queue_;
+      std::mutex retire_mutex_;
+      std::condition_variable_any retire_cv_; // wakes the retirement thread
+      std::condition_variable retired_cv_; // wakes threads waiting in 'drain_retire_queue'
+      size_t retire_enqueued_{};
+      size_t retire_done_{};
+      bool retention_started_{}; // the files left by earlier runs have been queued; guarded by 'io_mutex_'
+      std::once_flag retire_once_;
+      std::jthread retire_thread_;
+
+      // The split log files kept, oldest first, and their total size. Only used by the retirement thread.
+      //
+      std::deque<std::pair<std::string, size_t>> retained_log_files_;
+      size_t retained_log_bytes_{};
+
+      // Per-thread buffers: see 'notarius_opts_t::per_thread_buffers'.
+      //
+      inline static std::atomic<uint64_t> instance_count_{};
+      const uint64_t instance_id_{++instance_count_}; // identifies this logger in 'thread_staging_buffer'
+      std::atomic<uint64_t> sequence_{};
+      std::mutex staging_mutex_;
+      std::vector<std::shared_ptr<detail::staging_buffer_t>> staging_buffers_;
+      std::vector<std::string> collected_; // writer thread only
+      std::string staged_carry_; // writer thread only
+
+      // Queues a message for 'forward_to_'.
+      //
+      void forward(const std::string_view msg)
+      {
+         std::call_once(forward_once_, [this] {
+            forward_thread_ = std::jthread([this](std::stop_token stoken) { forward_loop(stoken); });
+         });
+
+         {
+            std::unique_lock lock(forward_mutex_);
+
+            // The forwarding thread does not wait for room in its own queue, which only it drains.
+            // This does not make logging from a 'forward_to' delegate safe (see: 'forward_to').
+            if (forward_queue_.size() + msg.size() > options_.forward_queue_capacity_bytes and
+                forward_thread_.get_id() != std::this_thread::get_id()) {
+               forward_cv_.notify_one();
+               forward_space_cv_.wait(lock, [&] {
+                  return forward_queue_.empty() ||
+                         forward_queue_.size() + msg.size() <= options_.forward_queue_capacity_bytes;
+               });
+            }
+
+            forward_queue_.append(msg);
+            forward_ends_.emplace_back(forward_queue_.size());
+            ++forward_enqueued_;
+         }
+
+         forward_cv_.notify_one();
+      }
+
+      void forward_loop(std::stop_token stoken)
+      {
+         std::string records;
+         std::vector<size_t> ends;
+         std::vector<std::string_view> batch;
+
+         while (true) {
+            {
+               std::unique_lock lock(forward_mutex_);
+               forward_cv_.wait(lock, stoken, [this] { return not forward_queue_.empty(); });
+               if (forward_queue_.empty()) return; // stop requested and nothing left to deliver
+               records.swap(forward_queue_);
+               ends.swap(forward_ends_);
+            }
+            forward_space_cv_.notify_all();
+
+            batch.clear();
+            size_t begin{};
+            for (const auto end : ends) {
+               batch.emplace_back(records.data() + begin, end - begin);
+               begin = end;
+            }
+
+            {
+               std::lock_guard delegate_lock(forward_to_mutex_);
+               const size_t batch_size = std::max<size_t>(options_.forward_batch_size, 1);
+               for (size_t i = 0; i < batch.size() and forward_to_; i += batch_size) {
+                  try {
+                     forward_to_(std::span(batch).subspan(i, std::min(batch_size, batch.size() - i)));
+                  }
+                  catch (const std::exception& e) {
+                     std::cerr << "Exception in 'forward_to': " << e.what() << std::endl;
+                  }
+                  catch (...) {
+                     std::cerr << "Unknown exception in 'forward_to'" << std::endl;
+                  }
+               }
+            }
+
+            {
+               std::lock_guard lock(forward_mutex_);
+               forward_delivered_ += ends.size();
+            }
+            forwarded_cv_.notify_all();
+
+            records.clear();
+            ends.clear();
+         }
+      }
+
+      // Blocks until every message forwarded so far has been delivered.
+      //
+      void drain_forward_queue()
+      {
+         if (not forward_thread_.joinable() or forward_thread_.get_id() == std::this_thread::get_id()) return;
+
+         std::unique_lock lock(forward_mutex_);
+         const size_t target = forward_enqueued_;
+         forward_cv_.notify_one();
+         forwarded_cv_.wait(lock, [&] { return forward_delivered_ >= target; });
+      }
+
+      void stop_forwarder()
+      {
+         if (not forward_thread_.joinable()) return;
+         forward_thread_.request_stop();
+         forward_thread_.join();
+      }
+
+      // Hands a log file that has been split off to the retirement thread, to be compressed
+      // and counted against the retention limits. The first time, the files of the log left by
+      // earlier runs are queued ahead of it, as listed by 'log_file_sequence_', so retention
+      // never lists the directory. Called with 'io_mutex_' held.
+      //
+      void retire_log_file(std::string path)
+      {
+         const bool compress = options_.compress_split_log_files and not options_.compress_log_files;
+         const bool retain = options_.max_split_log_files > 0 or options_.max_split_log_files_bytes > 0;
+         if (not compress and not retain) return;
+
+         std::call_once(retire_once_, [this] {
+            retire_thread_ = std::jthread([this](std::stop_token stoken) { retire_loop(stoken); });
+         });
+
+         {
+            std::lock_guard lock(retire_mutex_);
+            if (retain and not std::exchange(retention_started_, true)) {
+               for (auto& existing : log_file_sequence_.take_existing()) {
+                  retire_queue_.push_back({std::move(existing), false});
+                  ++retire_enqueued_;
+               }
+            }
+            retire_queue_.push_back({std::move(path), compress});
+            ++retire_enqueued_;
+         }
+         retire_cv_.notify_one();
+      }
+
+      void retire_loop(std::stop_token stoken)
+      {
+         while (true) {
+            retired_log_file_t file;
+            {
+               std::unique_lock lock(retire_mutex_);
+               retire_cv_.wait(lock, stoken, [this] { return not retire_queue_.empty(); });
+               if (retire_queue_.empty()) return; // stop requested and nothing left to do
+               file = std::move(retire_queue_.front());
+               retire_queue_.pop_front();
+            }
+
+            if (file.compress) {
+               try {
+                  lz4::compress_file(file.path);
+                  file.path += ".lz4";
+               }
+               catch (const std::exception& e) {
+                  std::cerr << std::format("Error compressing log file '{}': {}", file.path, e.what()) << std::endl;
+               }
+            }
+            retain_log_file(std::move(file.path));
+
+            {
+               std::lock_guard lock(retire_mutex_);
+               ++retire_done_;
+            }
+            retired_cv_.notify_all();
+         }
+      }
+
+      // Adds 'path' to the split log files kept, then removes the oldest ones until
+      // 'max_split_log_files' and 'max_split_log_files_bytes' hold. Called by the retirement thread.
+      //
+      void retain_log_file(std::string path)
+      {
+         const size_t max_files = options_.max_split_log_files;
+         const size_t max_bytes = options_.max_split_log_files_bytes;
+         if (max_files == 0 and max_bytes == 0) return;
+
+         std::error_code ec;
+         const auto bytes = std::filesystem::file_size(path, ec);
+         if (ec) return; // already removed
+         if (const auto it = std::ranges::find(retained_log_files_, path, &std::pair<std::string, size_t>::first);
+             it != retained_log_files_.end()) { // the log was closed and reopened in the same file
+            retained_log_bytes_ -= it->second;
+            retained_log_files_.erase(it);
+         }
+         retained_log_files_.emplace_back(std::move(path), static_cast<size_t>(bytes));
+         retained_log_bytes_ += static_cast<size_t>(bytes);
+
+         while (not retained_log_files_.empty() and
+                ((max_files > 0 and retained_log_files_.size() > max_files) or
+                 (max_bytes > 0 and retained_log_bytes_ > max_bytes))) {
+            auto& [oldest, oldest_bytes] = retained_log_files_.front();
+            std::filesystem::remove(oldest, ec);
+            retained_log_bytes_ -= oldest_bytes;
+            retained_log_files_.pop_front();
+         }
+      }
+
+      // Blocks until every log file handed to the retirement thread so far has been handled.
+      //
+      void drain_retire_queue()
+      {
+         if (not retire_thread_.joinable()) return;
+
+         std::unique_lock lock(retire_mutex_);
+         const size_t target = retire_enqueued_;
+         retired_cv_.wait(lock, [&] { return retire_done_ >= target; });
+      }
+
+      void stop_retirer()
+      {
+         if (not retire_thread_.joinable()) return;
+         retire_thread_.request_stop();
+         retire_thread_.join();
+      }
+
+      void start_writer()
+      {
+         writer_thread_ = std::jthread([this](std::stop_token stoken) { writer_loop(stoken); });
+      }
+
+      void stop_writer()
+      {
+         if (not writer_thread_.joinable()) return;
+         writer_thread_.request_stop();
+         queue_cv_.notify_all();
+         writer_thread_.join();
+      }
+
+      // Called with 'queue_mutex_' held.
+      //
+      bool writer_has_work()
+      {
+         if (drain_waiters_ > 0) {
+            return not async_queue_.empty() or committed_sequence_ < sequence_.load(std::memory_order_relaxed) or
+                   reported_drops_ < dropped_messages_.load(std::memory_order_relaxed);
+         }
+         return async_queue_.size() >= options_.async_queue_capacity_bytes / 2;
+      }
+
+      void writer_loop(std::stop_token stoken)
+      {
+         std::string batch;
+         std::string staged;
+         const auto interval = std::chrono::milliseconds(options_.async_flush_interval_ms);
+
+         while (true) {
+            size_t batch_end_record{};
+            bool stop_requested{};
+            {
+               std::unique_lock lock(queue_mutex_);
+               queue_cv_.wait_for(lock, stoken, interval, [this] { return writer_has_work(); });
+               stop_requested = stoken.stop_requested();
+               batch.swap(async_queue_);
+               batch_end_record = enqueued_records_;
+            }
+
+            if (not batch.empty()) space_cv_.notify_all();
+
+            const uint64_t staged_end_sequence = collect_staging_buffers(staged);
+            const uint64_t drops = dropped_messages_.load() - reported_drops_;
+
+            if (not batch.empty() or not staged.empty() or drops > 0) {
+               auto lock = get_exclusive_write_lock();
+               if (drops > 0) {
+                  commit(std::format("{}: {} messages dropped\n", to_string(log_level::warn), drops), log_level::warn,
+                         false);
+               }
+               commit_records(batch);
+               commit_records(staged);
+               write_handed_off_store(lock);
+            }
+
+            batch.clear();
+            staged.clear();
+
+            {
+               std::lock_guard lock(queue_mutex_);
+               committed_records_ = batch_end_record;
+               committed_sequence_ = staged_end_sequence;
+               reported_drops_ += drops;
+            }
+
+            drained_cv_.notify_all();
+            space_cv_.notify_all();
+
+            if (stop_requested and staged_carry_.empty()) {
+               std::lock_guard lock(queue_mutex_);
+               if (async_queue_.empty() and committed_sequence_ == sequence_.load() and
+                   reported_drops_ == dropped_messages_.load())
+                  return;
+            }
+         }
+      }
+
+      // Commits a sequence of 'detail::record_header_t' prefixed messages. Called with the lock held.
+      //
+      void commit_records(const std::string_view records)
+      {
+         for (size_t pos = 0; pos < records.size();) {
+            detail::record_header_t header;
+            std::memcpy(&header, records.data() + pos, sizeof(header));
+            pos += sizeof(header);
+            if (header.binary)
+               commit_binary(records.substr(pos, header.size), header.level, header.immediate);
+            else if (header.deferred)
+               commit(render_deferred(records.substr(pos, header.size), header.level), header.level, header.immediate);
+            else
+               commit(records.substr(pos, header.size), header.level, header.immediate);
+            pos += header.size;
+         }
+      }
+
+      // Formats a deferred record (see: 'detail::encode_deferred') on the writer thread.
+      //
+      std::string_view render_deferred(const std::string_view payload, const log_level level)
+      {
+         detail::deferred_record_t record;
+         std::memcpy(&record, payload.data(), sizeof(record));
+
+         return render_record(level, record.time, record.thread, [&](std::string& out) {
+            record.render(out, format_text(record.format), payload.data() + sizeof(record));
+         });
+      }
+
+      // Formats a binary record (see: 'detail::binary_record_t') on the writer thread.
+      //
+      std::string_view render_binary(const std::string_view payload, const log_level level)
+      {
+         static thread_local std::vector<nlog::argument_t> args;
+
+         detail::binary_record_t record;
+         std::memcpy(&record, payload.data(), sizeof(record));
+         nlog::decode_arguments(payload.substr(sizeof(record)), args);
+
+         return render_record(level, record.time, record.thread, [&](std::string& out) {
+            nlog::format_arguments(out, format_text(record.format), args);
+         });
+      }
+
+      // Lays out a message logged at 'time' (in ticks) by 'thread' as 'format_message' does;
+      // 'render' appends the formatted message.
+      //
+      template <class Render>
+      std::string_view render_record(const log_level level, const int64_t time, const uint32_t thread,
+                                     Render&& render)
+      {
+         static thread_local std::string msg;
+
+         msg.clear();
+         if constexpr (has_pattern) {
+            auto context = pattern_context(level, time);
+            context.thread = thread;
+            detail::emit_pattern<Options.pattern>(msg, context, render);
+         }
+         else {
+            if (options_.enable_timestamps) {
+               detail::append_timestamp(msg, detail::ticks_to_epoch_ns(options_.timestamp_clock, time),
+                                        options_.utc_timestamps, options_.timestamp_subsecond_digits);
+            }
+            if (log_level::none != level) msg.append(to_string(level)).append(": ");
+            render(msg);
+         }
+
+         if (options_.append_newline_when_missing) {
+            if (not msg.empty() and '\n' != msg.back()) {
+               msg.append("\n");
+            }
+         }
+
+         return msg;
+      }
+
+      void enqueue(const std::string_view msg, detail::record_header_t header)
+      {
+         std::call_once(writer_once_, [this] { start_writer(); });
+
+         header.size = static_cast<uint32_t>(msg.size());
+         const size_t record_size = sizeof(header) + msg.size();
+
+         bool wake_writer{};
+         {
+            std::unique_lock lock(queue_mutex_);
+
+            if (async_queue_.size() + record_size > options_.async_queue_capacity_bytes) {
+               queue_cv_.notify_one();
+
+               if (drop_on_overflow(header.level)) {
+                  count_drops(1);
+                  return;
+               }
+
+               if (options_.async_overflow_policy == overflow_policy::drop_oldest) {
+                  count_drops(drop_oldest_records(async_queue_, 0, record_size));
+               }
+               else {
+                  space_cv_.wait(lock, [&] {
+                     return async_queue_.empty() ||
+                            async_queue_.size() + record_size <= options_.async_queue_capacity_bytes;
+                  });
+               }
+            }
+
+            async_queue_.append(reinterpret_cast<const char*>(&header), sizeof(header));
+            async_queue_.append(msg);
+            ++enqueued_records_;
+
+            wake_writer = async_queue_.size() >= options_.async_queue_capacity_bytes / 2;
+         }
+
+         if (wake_writer) queue_cv_.notify_one();
+      }
+
+      // Whether a message logged at 'level' into a full queue is dropped instead of waiting.
+      //
+      bool drop_on_overflow(const log_level level) const
+      {
+         switch (options_.async_overflow_policy) {
+         case overflow_policy::drop_newest:
+            return true;
+         case overflow_policy::drop_below_level:
+            return level < options_.async_overflow_level;
+         default:
+            return false;
+         }
+      }
+
+      // Erases the oldest records from 'records' until a record of 'record_size' bytes fits
+      // into 'async_queue_capacity_bytes'. Each record is 'detail::record_header_t' prefixed,
+      // following 'prefix_size' bytes (e.g., a sequence number). Returns the number of records erased.
+      //
+      size_t drop_oldest_records(std::string& records, const size_t prefix_size, const size_t record_size)
+      {
+         size_t pos{};
+         size_t count{};
+         while (pos < records.size() and records.size() - pos + record_size > options_.async_queue_capacity_bytes) {
+            detail::record_header_t header;
+            std::memcpy(&header, records.data() + pos + prefix_size, sizeof(header));
+            pos += prefix_size + sizeof(header) + header.size;
+            ++count;
+         }
+         records.erase(0, pos);
+         return count;
+      }
+
+      void count_drops(const size_t count)
+      {
+         if (count == 0) return;
+         dropped_messages_.fetch_add(count, std::memory_order_relaxed);
+      }
+
+      detail::staging_buffer_t& thread_staging_buffer()
+      {
+         struct registration_t final
+         {
+            uint64_t instance_id{};
+            std::shared_ptr<detail::staging_buffer_t> buffer;
+         };
+
+         static thread_local std::vector<registration_t> registrations;
+
+         for (auto& registration : registrations) {
+            if (registration.instance_id == instance_id_) return *registration.buffer;
+         }
+
+         // Drop the buffers of loggers that no longer exist.
+         std::erase_if(registrations, [](const auto& registration) { return registration.buffer.use_count() == 1; });
+
+         auto buffer = std::make_shared<detail::staging_buffer_t>();
+         {
+            std::lock_guard lock(staging_mutex_);
+            staging_buffers_.push_back(buffer);
+         }
+         registrations.push_back({instance_id_, buffer});
+         return *buffer;
+      }
+
+      void stage(const std::string_view msg, detail::record_header_t header)
+      {
+         std::call_once(writer_once_, [this] { start_writer(); });
+
+         auto& buffer = thread_staging_buffer();
+         header.size = static_cast<uint32_t>(msg.size());
+         const size_t record_size = sizeof(uint64_t) + sizeof(header) + msg.size();
+
+         size_t size{};
+         {
+            std::lock_guard lock(buffer.mutex);
+
+            if (buffer.records.size() + record_size > options_.async_queue_capacity_bytes) {
+               if (drop_on_overflow(header.level)) {
+                  count_drops(1);
+                  return;
+               }
+               if (options_.async_overflow_policy == overflow_policy::drop_oldest) {
+                  count_drops(drop_oldest_records(buffer.records, sizeof(uint64_t), record_size));
+               }
+            }
+
+            // The sequence number is taken with the buffer locked so that the writer thread,
+            // which locks every buffer after reading 'sequence_', sees every older record.
+            const uint64_t sequence = sequence_.fetch_add(1, std::memory_order_relaxed);
+            buffer.records.append(reinterpret_cast<const char*>(&sequence), sizeof(sequence));
+            buffer.records.append(reinterpret_cast<const char*>(&header), sizeof(header));
+            buffer.records.append(msg);
+            size = buffer.records.size();
+            buffer.size.store(size, std::memory_order_relaxed);
+         }
+
+         if (size >= options_.async_queue_capacity_bytes / 2) queue_cv_.notify_one();
+
+         if (size > options_.async_queue_capacity_bytes) {
+            std::unique_lock lock(queue_mutex_);
+            space_cv_.wait(lock, [&] {
+               return buffer.size.load(std::memory_order_relaxed) <= options_.async_queue_capacity_bytes;
+            });
+         }
+      }
+
+      // Swaps out the staging buffers and merges their records by sequence number into 'merged'.
+      // Records numbered at or above the returned sequence are carried over to the next call,
+      // since an older record from another thread may not have been staged yet.
+      //
+      uint64_t collect_staging_buffers(std::string& merged)
+      {
+         const uint64_t end_sequence = sequence_.load();
+
+         {
+            std::lock_guard lock(staging_mutex_);
+
+            collected_.resize(staging_buffers_.size() + 1);
+            collected_.back().swap(staged_carry_);
+
+            size_t orphaned_count{};
+            for (size_t i = 0; i < staging_buffers_.size(); ++i) {
+               // A buffer only referenced by the logger belongs to an exited thread; once
+               // emptied below nothing can be appended to it again and it is released.
+               const bool orphaned = staging_buffers_[i].use_count() == 1;
+               auto& buffer = *staging_buffers_[i];
+               {
+                  std::lock_guard buffer_lock(buffer.mutex);
+                  collected_[i].swap(buffer.records);
+                  buffer.size.store(0, std::memory_order_relaxed);
+               }
+               if (orphaned) {
+                  staging_buffers_[i].reset();
+                  ++orphaned_count;
+               }
+            }
+
+            if (orphaned_count > 0) std::erase(staging_buffers_, nullptr);
+         }
+
+         struct cursor_t final
+         {
+            uint64_t sequence{};
+            size_t source{};
+            size_t pos{};
+            bool operator>(const cursor_t& other) const { return sequence > other.sequence; }
+         };
+
+         auto read_sequence = [](const std::string& records, const size_t pos) {
+            uint64_t sequence{};
+            std::memcpy(&sequence, records.data() + pos, sizeof(sequence));
+            return sequence;
+         };
+
+         std::priority_queue<cursor_t, std::vector<cursor_t>, std::greater<>> cursors;
+         for (size_t i = 0; i < collected_.size(); ++i) {
+            if (not collected_[i].empty()) cursors.push({read_sequence(collected_[i], 0), i, 0});
+         }
+
+         while (not cursors.empty()) {
+            auto cursor = cursors.top();
+            cursors.pop();
+
+            const auto& records = collected_[cursor.source];
+            detail::record_header_t header;
+            std::memcpy(&header, records.data() + cursor.pos + sizeof(uint64_t), sizeof(header));
+            const size_t record_size = sizeof(uint64_t) + sizeof(header) + header.size;
+
+            if (cursor.sequence < end_sequence)
+               merged.append(records, cursor.pos + sizeof(uint64_t), record_size - sizeof(uint64_t));
+            else
+               staged_carry_.append(records, cursor.pos, record_size);
+
+            cursor.pos += record_size;
+            if (cursor.pos < records.size()) {
+               cursor.sequence = read_sequence(records, cursor.pos);
+               cursors.push(cursor);
+            }
+         }
+
+         for (auto& records : collected_) records.clear();
+
+         return end_sequence;
+      }
+
+      // Lock-free append path: see 'notarius_opts_t::lock_free_enabled'.
+      //
+      std::atomic<detail::log_segment_t*> active_segment_{};
+      std::atomic<detail::log_segment_t*> spare_segment_{};
+      std::atomic<detail::log_segment_t*> sealed_segments_{}; // most recently sealed first
+      std::vector<detail::log_segment_t*> free_segments_; // guarded by 'mutex_'
+
+      detail::log_segment_t* make_segment()
+      {
+         if (auto* segment = spare_segment_.exchange(nullptr)) return segment;
+         return new detail::log_segment_t(options_.lock_free_segment_bytes);
+      }
+
+      // Called by the producer whose reservation at 'offset' crossed the end of 'segment'.
+      //
+      void seal_segment(detail::log_segment_t* segment, const size_t offset)
+      {
+         segment->sealed_size = offset;
+
+         // Publish before the replacement is installed so that the segments are
+         // listed in the order they were filled.
+         segment->next_sealed = sealed_segments_.load(std::memory_order_relaxed);
+         while (not sealed_segments_.compare_exchange_weak(segment->next_sealed, segment, std::memory_order_release,
+                                                           std::memory_order_relaxed)) {
+         }
+
+         active_segment_.store(make_segment(), std::memory_order_release);
+      }
+
+      // Seals the active segment, if it holds any data, so that it is written by the next 'drain_segments'.
+      //
+      void seal_active_segment()
+      {
+         auto* segment = active_segment_.load(std::memory_order_acquire);
+         if (not segment or segment->reserved.load() == 0) return;
+
+         // Reserving more than the capacity prevents any further reservations.
+         const size_t offset = segment->reserved.fetch_add(segment->capacity + 1);
+         if (offset <= segment->capacity) seal_segment(segment, offset);
+      }
+
+      void append_lock_free(const std::string_view msg)
+      {
+         if (msg.size() > options_.lock_free_segment_bytes) {
+            auto lock = get_exclusive_write_lock();
+            seal_active_segment();
+            drain_segments();
+            store(msg);
+            write_handed_off_store(lock);
+            return;
+         }
+
+         while (true) {
+            auto* segment = active_segment_.load(std::memory_order_acquire);
+
+            if (not segment) {
+               auto* initial = new detail::log_segment_t(options_.lock_free_segment_bytes);
+               if (not active_segment_.compare_exchange_strong(segment, initial)) delete initial;
+               continue;
+            }
+
+            segment->writers.fetch_add(1);
+
+            // The segment may have been sealed and recycled since it was loaded.
+            if (active_segment_.load() != segment) {
+               segment->writers.fetch_sub(1, std::memory_order_release);
+               continue;
+            }
+
+            const size_t offset = segment->reserved.fetch_add(msg.size());
+
+            if (offset + msg.size() <= segment->capacity) {
+               std::memcpy(segment->data.get() + offset, msg.data(), msg.size());
+               segment->writers.fetch_sub(1, std::memory_order_release);
+               return;
+            }
+
+            segment->writers.fetch_sub(1, std::memory_order_release);
+
+            if (offset <= segment->capacity) {
+               seal_segment(segment, offset);
+
+               auto lock = get_exclusive_write_lock();
+               drain_segments();
+               write_handed_off_store(lock);
+            }
+            else {
+               std::this_thread::yield(); // another producer is installing the next segment
+            }
+         }
+      }
+
+      // Writes the sealed segments to the logging store. Called with the lock held.
+      //
+      void drain_segments()
+      {
+         auto* sealed = sealed_segments_.exchange(nullptr, std::memory_order_acquire);
+
+         detail::log_segment_t* in_order{};
+         while (sealed) {
+            auto* next = sealed->next_sealed;
+            sealed->next_sealed = in_order;
+            in_order = sealed;
+            sealed = next;
+         }
+
+         while (in_order) {
+            auto* segment = in_order;
+            in_order = segment->next_sealed;
+
+            // Wait for the sealing producer to install the replacement and for copies in flight.
+            while (active_segment_.load() == segment or segment->writers.load(std::memory_order_acquire) != 0) {
+               std::this_thread::yield();
+            }
+
+            store(std::string_view(segment->data.get(), segment->sealed_size));
+
+            segment->reserved.store(0);
+            segment->next_sealed = nullptr;
+            free_segments_.push_back(segment);
+         }
+
+         if (not free_segments_.empty() and not spare_segment_.load()) {
+            detail::log_segment_t* expected{};
+            if (spare_segment_.compare_exchange_strong(expected, free_segments_.back())) free_segments_.pop_back();
+         }
+      }
+
+      void delete_segments()
+      {
+         delete active_segment_.exchange(nullptr);
+         delete spare_segment_.exchange(nullptr);
+         for (auto* segment : free_segments_) delete segment;
+         free_segments_.clear();
+      }
+
+      // Blocks until the writer thread has committed every message enqueued so far.
+      //
+      void drain_async_queue()
+      {
+         if (not writer_thread_.joinable() or writer_thread_.get_id() == std::this_thread::get_id()) return;
+
+         std::unique_lock lock(queue_mutex_);
+         const size_t target = enqueued_records_;
+         const uint64_t target_sequence = sequence_.load();
+         const uint64_t target_drops = dropped_messages_.load();
+         auto drained = [&] {
+            return committed_records_ >= target and committed_sequence_ >= target_sequence and
+                   reported_drops_ >= target_drops;
+         };
+         if (drained()) return;
+         ++drain_waiters_;
+         queue_cv_.notify_one();
+         drained_cv_.wait(lock, drained);
+         --drain_waiters_;
+      }
+
+      // notarius helper method; flush a msg to an ostream
+      //
+      template <log_level level, bool flush = true, is_loggable... Args>
+      void update_io_buffer(std::ostream& buffer, std::format_string<Args...> fmt, Args&&... args)
+      {
+         if constexpr (is_enabled<level>) {
+            if (level != log_level::none and level < min_level_.load(std::memory_order_relaxed)) return;
+
+            static thread_local std::string msg;
+
+            if constexpr (log_level::none != level) msg.append(to_string(level)).append(": ");
+            std::format_to(std::back_inserter(msg), fmt, std::forward<Args>(args)...);
+
+            buffer.write(msg.c_str(), msg.size());
+
+            buffer.flush();
+
+            msg.clear();
+         }
+      }
+
+      void flush_cout()
+      {
+         if (are_rdbufs_equal(log_output_stream_, std::cout)) {
+            flush();
+            cout_store_.clear();
+            return;
+         }
+         if (cout_store_.empty()) return;
+         std::cout << cout_store_;
+         cout_store_.clear();
+         std::cout.flush();
+      }
+
+      void flush_cerr()
+      {
+         if (are_rdbufs_equal(log_output_stream_, std::cerr)) {
+            flush();
+            cerr_store_.clear();
+            return;
+         }
+         if (cerr_store_.empty()) return;
+         std::cerr << cerr_store_;
+         cerr_store_.clear();
+         std::cerr.flush();
+      }
+
+      void flush_clog()
+      {
+         if (are_rdbufs_equal(log_output_stream_, std::clog)) {
+            flush();
+            clog_store_.clear();
+            return;
+         }
+         if (clog_store_.empty()) return;
+         std::clog << clog_store_;
+         clog_store_.clear();
+         std::clog.flush();
+      }
+
+      // Writes the standard output stores. Unless a stream has been redirected, each file
+      // descriptor gets a single writev(2): 'cout_store_' for stdout, and 'cerr_store_' followed
+      // by 'clog_store_' for stderr.
+      //
+      void flush_std_outputs()
+      {
+#if defined(NOTARIUS_HAS_WRITEV)
+         if (std::cout.rdbuf() == detail::standard_cout_rdbuf and std::cerr.rdbuf() == detail::standard_cerr_rdbuf and
+             std::clog.rdbuf() == detail::standard_clog_rdbuf) {
+            if (not cout_store_.empty()) {
+               // Whatever is buffered by the stream, or by stdout when synced with stdio, goes first.
+               std::cout.flush();
+               std::fflush(stdout);
+               detail::write_gathered<1>(::fileno(stdout), {cout_store_});
+               cout_store_.clear();
+            }
+
+            if (not cerr_store_.empty() or not clog_store_.empty()) {
+               std::cerr.flush();
+               std::clog.flush();
+               std::fflush(stderr);
+               detail::write_gathered<2>(::fileno(stderr), {cerr_store_, clog_store_});
+               cerr_store_.clear();
+               clog_store_.clear();
+            }
             return;
          }
-         if (cerr_store_.empty()) return;
-         std::cerr << cerr_store_;
-         cerr_store_.clear();
-         std::cerr.flush();
+#endif
+         flush_cout();
+         flush_cerr();
+         flush_clog();
+      }
+
+      // Writes a formatted message to 'sinks_' and the standard outputs.
+      //
+      void write_to_outputs(const std::string_view msg, const log_level level, const bool immediate)
+      {
+         if constexpr (has_sinks) std::apply([&](Sinks&... sink) { (sink.write(msg, level), ...); }, sinks_);
+         write_to_std_output_stores(msg, level, immediate);
+      }
+
+      void flush_sinks()
+      {
+         std::apply([](Sinks&... sink) { (flush_sink(sink), ...); }, sinks_);
+      }
+
+      template <typename Sink>
+      static void flush_sink(Sink& sink)
+      {
+         if constexpr (requires { sink.flush(); }) sink.flush();
+      }
+
+      // Called from 'write_to_outputs' only...do not call from other locations!
+      //
+      void write_to_std_output_stores(const std::string_view msg, log_level level, const bool immediate)
+      {
+         if (!options_.enable_file_logging &&
+             (options_.enable_stdout || options_.enable_stderr || options_.enable_stdlog)) {
+            options_.enable_file_logging = true;
+         }
+
+         if (not options_.enable_stdout and not options_.enable_stderr and not options_.enable_stdlog) return;
+
+         auto immediate_mode = options_.immediate_mode || immediate;
+
+         if (options_.enable_stdout && level <= log_level::warn) {
+            if (are_rdbufs_equal(log_output_stream_, std::cout)) {
+               return;
+            }
+            else if (immediate_mode and cout_store_.empty()) {
+               // Nothing is buffered, so the message is written from where it was formatted.
+               std::cout.write(msg.data(), msg.size());
+               std::cout.flush();
+            }
+            else {
+               cout_store_.append(msg);
+
+               if (immediate_mode || (cout_store_.size() >= options_.flush_to_std_outputs_at_bytes)) {
+                  flush_cout();
+               }
+            }
+         }
+
+         if (options_.enable_stderr && level >= log_level::error) {
+            if (are_rdbufs_equal(log_output_stream_, std::cerr)) {
+               return;
+            }
+            else if (immediate_mode and cerr_store_.empty()) {
+               std::cerr.write(msg.data(), msg.size());
+               std::cerr.flush();
+            }
+            else {
+               cerr_store_.append(msg);
+
+               if (immediate_mode || (cerr_store_.size() >= options_.flush_to_std_outputs_at_bytes)) {
+                  flush_cerr();
+               }
+            }
+         }
+
+         if (options_.enable_stdlog) {
+            if (are_rdbufs_equal(log_output_stream_, std::clog)) {
+               return;
+            }
+            else if (immediate_mode and clog_store_.empty()) {
+               std::clog.write(msg.data(), msg.size());
+               std::clog.flush();
+            }
+            else {
+               clog_store_.append(msg);
+
+               if (immediate_mode || (clog_store_.size() >= options_.flush_to_std_outputs_at_bytes)) {
+                  flush_clog();
+               }
+            }
+         }
+      }
+
+      static constexpr bool has_pattern = Options.pattern.size > 0;
+
+      // Reads a tick of 'timestamp_clock' when messages are timestamped, otherwise returns 0.
+      //
+      int64_t timestamp() const
+      {
+         bool timestamped = options_.enable_timestamps;
+         if constexpr (has_pattern) timestamped = detail::parsed_pattern<Options.pattern>.has_time;
+         return timestamped ? detail::clock_ticks(options_.timestamp_clock) : 0;
+      }
+
+      detail::pattern_context_t pattern_context(const log_level level, const int64_t ticks) const
+      {
+         return {.time = ticks == 0 ? 0 : detail::ticks_to_epoch_ns(options_.timestamp_clock, ticks),
+                 .utc = options_.utc_timestamps,
+                 .level = level,
+                 .thread = detail::this_thread_number()};
+      }
+
+      // Appends the message, laid out by 'pattern' or prefixed with its level label, to 'out'.
+      //
+      template <log_level level, is_loggable... Args>
+      void format_message(std::string& out, std::format_string<Args...> fmt, Args&&... args)
+      {
+         const size_t begin = out.size();
+
+         if constexpr (has_pattern) {
+            detail::emit_pattern<Options.pattern>(out, pattern_context(level, timestamp()), [&](std::string& o) {
+               std::format_to(std::back_inserter(o), fmt, std::forward<Args>(args)...);
+            });
+         }
+         else {
+            if (options_.enable_timestamps) {
+               detail::append_timestamp(out, detail::ticks_to_epoch_ns(options_.timestamp_clock, timestamp()),
+                                        options_.utc_timestamps, options_.timestamp_subsecond_digits);
+            }
+
+            if constexpr (log_level::none != level) out.append(to_string(level)).append(": ");
+
+            std::format_to(std::back_inserter(out), fmt, std::forward<Args>(args)...);
+         }
+
+         if (options_.append_newline_when_missing) {
+            if (out.size() > begin and '\n' != out.back()) {
+               out.append("\n");
+            }
+         }
+      }
+
+      // Writes a formatted message to the standard outputs and the logging store.
+      // Called from 'print' with the lock held, or from the writer thread in async mode.
+      //
+      void commit(const std::string_view msg, const log_level level, const bool immediate)
+      {
+         write_to_outputs(msg, level, immediate);
+
+         if (forwarding_.load(std::memory_order_relaxed)) forward(msg);
+
+         store(msg);
+      }
+
+      // Appends a message to the logging store, flushing or splitting the log file as needed.
+      // Called with the lock held.
+      //
+      void store(const std::string_view msg)
+      {
+         const size_t begin = begin_store();
+         if (options_.binary_format)
+            nlog::append_text(logging_store_, msg);
+         else
+            logging_store_.append(msg);
+         end_store(begin);
+      }
+
+      // Writes a binary record (see: 'detail::binary_record_t') to the standard outputs and
+      // 'forward_to_' as text, and to the logging store as is (see: 'store_binary').
+      // Called with the lock held.
+      //
+      void commit_binary(const std::string_view record, const log_level level, const bool immediate)
+      {
+         if (writes_text()) {
+            const auto msg = render_binary(record, level);
+            write_to_outputs(msg, level, immediate);
+            if (forwarding_.load(std::memory_order_relaxed)) forward(msg);
+         }
+
+         store_binary(record, level);
+      }
+
+      // Whether messages are written as text anywhere besides the log file.
+      //
+      bool writes_text() const
+      {
+         return has_sinks or options_.enable_stdout or options_.enable_stderr or options_.enable_stdlog or
+                forwarding_.load(std::memory_order_relaxed);
+      }
+
+      // Appends a binary record to the logging store as a message record of the binary log,
+      // preceded by the definition of its format string if this is its first use.
+      // Called with the lock held.
+      //
+      void store_binary(const std::string_view record, const log_level level)
+      {
+         detail::binary_record_t header;
+         std::memcpy(&header, record.data(), sizeof(header));
+
+         const size_t begin = begin_store();
+         define_format(header.format);
+         const int64_t time = header.time == 0 ? 0 : detail::ticks_to_epoch_ns(options_.timestamp_clock, header.time);
+         nlog::append_message(logging_store_, header.format, time, header.thread, level, record.substr(sizeof(header)));
+         end_store(begin);
+      }
+
+      // Defines a format string in the logging store the first time this logger writes it.
+      // Called with the lock held.
+      //
+      void define_format(const uint32_t id)
+      {
+         if (id < defined_formats_.size() and defined_formats_[id]) return;
+
+         if (id >= defined_formats_.size()) defined_formats_.resize(id + 1);
+         defined_formats_[id] = true;
+
+         const auto fmt = format_text(id);
+         nlog::append_format(logging_store_, id, fmt);
+
+         std::lock_guard lock(formats_mutex_);
+         nlog::append_format(formats_, id, fmt);
+      }
+
+      static std::string_view format_text(const uint32_t id)
+      {
+         return detail::format_table_t::instance().entry(id).text;
+      }
+
+      // Writes the header of a binary log file, followed by the format strings defined so far.
+      // Called with 'io_mutex_' held.
+      //
+      void write_binary_log_header()
+      {
+         std::string header;
+         nlog::append_header(header, {.pattern = Options.pattern.sv(),
+                                      .enable_timestamps = options_.enable_timestamps,
+                                      .utc_timestamps = options_.utc_timestamps,
+                                      .append_newline_when_missing = options_.append_newline_when_missing,
+                                      .timestamp_subsecond_digits = options_.timestamp_subsecond_digits});
+         {
+            std::lock_guard lock(formats_mutex_);
+            header.append(formats_);
+         }
+
+         if (options_.compress_log_files) {
+            std::string frame; // not 'compressed_store_', which may hold the store being written
+            lz4::compress(header, frame);
+            header.swap(frame);
+         }
+         write_log_file(header);
       }
 
-      void flush_clog()
+      bool log_file_is_open() const
       {
-         if (are_rdbufs_equal(log_output_stream_, std::clog)) {
-            flush();
-            clog_store_.clear();
+#if defined(NOTARIUS_HAS_MMAP)
+         if (mapped_file_.is_open()) return true;
+#endif
+#if defined(NOTARIUS_HAS_IO_URING)
+         if (uring_file_.is_open()) return true;
+#endif
+#if defined(NOTARIUS_HAS_O_DIRECT)
+         if (direct_file_.is_open()) return true;
+#endif
+         return log_output_stream_.is_open();
+      }
+
+      // Appends 'data' to the open log file; 'data' is left empty. Called with 'io_mutex_' held.
+      //
+      void write_log_file(std::string& data)
+      {
+         log_file_bytes_ += data.size();
+
+#if defined(NOTARIUS_HAS_MMAP)
+         if (mapped_file_.is_open()) {
+            mapped_file_.append(data);
+            data.clear();
             return;
          }
-         if (clog_store_.empty()) return;
-         std::clog << clog_store_;
-         clog_store_.clear();
-         std::clog.flush();
+#endif
+#if defined(NOTARIUS_HAS_IO_URING)
+         if (uring_file_.is_open()) {
+            uring_file_.append(data); // exchanges 'data' for a buffer that has been written
+            return;
+         }
+#endif
+#if defined(NOTARIUS_HAS_O_DIRECT)
+         if (direct_file_.is_open()) {
+            direct_file_.append(data);
+            data.clear();
+            return;
+         }
+#endif
+         // Note:
+         //
+         // The following will write data to the file stream, either directly if buffering is
+         // disabled(pubsetbuf(0, 0)),or indirectly via an internal buffer if buffering is enabled.
+         //
+         // For details see where 'options_.disable_file_buffering' is being used.
+         //
+         log_output_stream_.write(data.data(), data.size());
+         log_output_stream_.flush();
+         data.clear();
       }
 
-      void flush_std_outputs()
+      // Waits for writes to the log file that are still in flight. Called with 'io_mutex_' held.
+      //
+      void wait_log_file()
       {
-         flush_cout();
-         flush_cerr();
-         flush_clog();
+#if defined(NOTARIUS_HAS_IO_URING)
+         uring_file_.wait();
+#endif
+      }
+
+      void close_log_file()
+      {
+#if defined(NOTARIUS_HAS_FALLOCATE)
+         const bool trim = std::exchange(log_file_preallocated_, false);
+#endif
+#if defined(NOTARIUS_HAS_MMAP)
+         mapped_file_.close();
+#endif
+#if defined(NOTARIUS_HAS_IO_URING)
+         uring_file_.close();
+#endif
+#if defined(NOTARIUS_HAS_O_DIRECT)
+         direct_file_.close();
+#endif
+         log_output_stream_.close();
+#if defined(NOTARIUS_HAS_FALLOCATE)
+         if (trim) detail::trim_file(log_output_file_path_);
+#endif
+      }
+
+      bool preallocates_log_file() const
+      {
+#if defined(NOTARIUS_HAS_FALLOCATE)
+         return options_.preallocate_log_files and options_.split_log_files;
+#else
+         return false;
+#endif
       }
 
-      // Called from 'print' only...do not call from other locations!
+      // Allocates the blocks of the log file just opened up to the split size; they are released
+      // again by 'close_log_file'. Called with 'io_mutex_' held.
       //
-      void write_to_std_output_stores(const std::string& msg, log_level level)
+      void preallocate_log_file()
       {
-         if (!options_.enable_file_logging &&
-             (options_.enable_stdout || options_.enable_stderr || options_.enable_stdlog)) {
-            options_.enable_file_logging = true;
+#if defined(NOTARIUS_HAS_FALLOCATE)
+         if (not preallocates_log_file() or log_file_bytes_ >= options_.split_log_file_at_size_bytes) return;
+         detail::preallocate_file(log_output_file_path_, options_.split_log_file_at_size_bytes);
+         log_file_preallocated_ = true;
+#endif
+      }
+
+      // Formats a message straight into the logging store and writes the same bytes to the
+      // standard outputs and 'forward_to_'. Called from 'print' with the lock held.
+      //
+      template <log_level level, is_loggable... Args>
+      void format_and_commit(const bool immediate, std::format_string<Args...> fmt, Args&&... args)
+      {
+         const size_t begin = begin_store();
+
+         // In a binary log the message becomes a text record; its size is filled in below.
+         if (options_.binary_format) nlog::append_text(logging_store_, {});
+         const size_t msg_begin = logging_store_.size();
+
+         try {
+            format_message<level>(logging_store_, fmt, std::forward<Args>(args)...);
+         }
+         catch (...) {
+            logging_store_.resize(begin);
+            throw;
          }
 
-         if (not options_.enable_stdout and not options_.enable_stderr and not options_.enable_stdlog) return;
+         const std::string_view msg{logging_store_.data() + msg_begin, logging_store_.size() - msg_begin};
 
-         auto immediate_mode = options_.immediate_mode || toggle_immediate_mode_;
+         if (options_.binary_format) {
+            const auto size = static_cast<uint32_t>(msg.size());
+            std::memcpy(logging_store_.data() + msg_begin - sizeof(size), &size, sizeof(size));
+         }
 
-         toggle_immediate_mode_ = false;
+         write_to_outputs(msg, level, immediate);
 
-         if (options_.enable_stdout && level <= log_level::warn) {
-            if (are_rdbufs_equal(log_output_stream_, std::cout)) {
-               return;
-            }
-            else
-               cout_store_.append(msg);
+         if (forwarding_.load(std::memory_order_relaxed)) forward(msg);
 
-            if (immediate_mode || (cout_store_.size() >= options_.flush_to_std_outputs_at_bytes)) {
-               flush_cout();
-            }
+         end_store(begin);
+      }
+
+      // Returns where the next message starts in the logging store. Called with the lock held.
+      //
+      size_t begin_store()
+      {
+         if (reserve_once) {
+            reserve_once = false;
+            reserve_store_capacities();
          }
+         return logging_store_.size();
+      }
 
-         if (options_.enable_stderr && level >= log_level::error) {
-            if (are_rdbufs_equal(log_output_stream_, std::cerr)) {
-               return;
-            }
-            else
-               cerr_store_.append(msg);
+      // Hands off the logging store once the message appended at 'begin' takes it past the
+      // flush size; the message itself starts the next store. When splitting, the store is
+      // handed off before it holds more than a log file may; see 'write_flush_store' for
+      // where the log file is split. Called with the lock held.
+      //
+      void end_store(const size_t begin)
+      {
+         size_t flush_at_bytes = options_.flush_to_log_at_bytes;
+         if (options_.split_log_files) flush_at_bytes = std::min(flush_at_bytes, options_.split_log_file_at_size_bytes);
 
-            if (immediate_mode || (cerr_store_.size() >= options_.flush_to_std_outputs_at_bytes)) {
-               flush_cerr();
-            }
+         if (begin > 0 and logging_store_.size() > flush_at_bytes) hand_off_store(begin);
+      }
+
+      // Swaps the logging store into 'flush_store_', to be written once 'mutex_' has been
+      // released (see: 'write_handed_off_store'). Bytes from 'keep_from' onwards stay in the
+      // logging store. Called with the lock held.
+      //
+      void hand_off_store(const size_t keep_from = std::string::npos)
+      {
+         if (io_handoff_.owns_lock()) {
+            // The store filled up again within a single locked section (e.g., a batch of the
+            // writer thread); the pending store has to be written first.
+            write_flush_store();
+         }
+         else {
+            io_handoff_.lock();
          }
 
-         if (options_.enable_stdlog) {
-            if (are_rdbufs_equal(log_output_stream_, std::clog)) {
-               return;
-            }
-            else
-               clog_store_.append(msg);
+         logging_store_.swap(flush_store_);
 
-            if (immediate_mode || (clog_store_.size() >= options_.flush_to_std_outputs_at_bytes)) {
-               flush_clog();
-            }
+         if (keep_from < flush_store_.size()) {
+            logging_store_.append(flush_store_, keep_from);
+            flush_store_.resize(keep_from);
          }
       }
 
-      void flush_impl()
+      // Writes a store handed off while 'lock' was held, after releasing 'lock'.
+      //
+      void write_handed_off_store(std::unique_lock<std::shared_mutex>& lock)
       {
-         flush_std_outputs();
+         if (not io_handoff_.owns_lock()) return;
 
-         if (logging_store_.empty()) return;
+         std::unique_lock<std::mutex> io_lock(std::move(io_handoff_));
+         io_handoff_ = std::unique_lock<std::mutex>(io_mutex_, std::defer_lock);
+         lock.unlock();
+
+         write_flush_store();
+      }
+
+      // Writes 'flush_store_' to the log file, splitting the log file first when the
+      // store would take it past 'split_log_file_at_size_bytes'. Called with 'io_mutex_' held.
+      //
+      void write_flush_store()
+      {
+         if (flush_store_.empty()) return;
 
          if (options_.enable_file_logging) {
+            std::string& data = options_.compress_log_files ? compress_log_data(flush_store_) : flush_store_;
+
+            bool opening = not log_file_is_open();
+            if (not opening and log_file_bytes_ > 0 and log_file_is_due_for_split(data.size())) {
+               split_log_file();
+               opening = true;
+            }
+
             open_log_output_stream();
+            if (opening) {
+               log_file_opened_at_ = std::chrono::steady_clock::now();
+               if (options_.binary_format) write_binary_log_header();
+            }
 
-            // Note:
-            //
-            // The following will write data to the file stream, either directly if buffering is
-            // disabled(pubsetbuf(0, 0)),or indirectly via an internal buffer if buffering is enabled.
-            //
-            // For details see where 'options_.disable_file_buffering' is being used.
-            //
-            log_output_stream_.write(logging_store_.c_str(), logging_store_.size());
-            log_output_stream_.flush();
+            write_log_file(data);
+            preopen_next_log_file();
          }
 
-         logging_store_.clear();
+         flush_store_.clear();
+      }
+
+      // Returns the LZ4 frame compressing 'data', which is left empty (see: 'compress_log_files').
+      // Called with 'io_mutex_' held.
+      //
+      std::string& compress_log_data(std::string& data)
+      {
+         compressed_store_.clear();
+         lz4::compress(data, compressed_store_);
+         data.clear();
+         return compressed_store_;
+      }
+
+      // Whether writing 'bytes' would take the log file past 'split_log_file_at_size_bytes',
+      // or the log file has been open for 'split_log_file_interval_seconds'.
+      //
+      bool log_file_is_due_for_split(const size_t bytes) const
+      {
+         if (not options_.split_log_files) return false;
+         if (log_file_bytes_ + bytes > options_.split_log_file_at_size_bytes) return true;
+
+         const std::chrono::seconds interval(options_.split_log_file_interval_seconds);
+         return interval.count() > 0 and std::chrono::steady_clock::now() - log_file_opened_at_ >= interval;
+      }
+
+      // Closes the log file and continues the log in the next file of 'log_file_sequence_',
+      // switching to the file opened ahead by 'preopen_next_log_file' when there is one.
+      // The closed file is handed to 'retire_log_file'. Called with 'io_mutex_' held.
+      //
+      void split_log_file()
+      {
+         close_log_file();
+         std::string closed_path = log_output_file_path_;
+
+         if (next_log_output_stream_.is_open()) {
+            log_output_stream_.swap(next_log_output_stream_);
+            log_output_file_path_ = std::exchange(next_log_file_path_, {});
+            log_file_bytes_ = next_log_file_bytes_;
+            preallocate_log_file();
+         }
+         else {
+            log_output_file_path_ = log_file_sequence_.next(log_output_file_path_, default_extension);
+         }
+         retire_log_file(std::move(closed_path));
+      }
+
+      // Opens the file the log will be split into once the log file is half full (or half its
+      // interval has passed), so that the split itself only swaps streams. Only done for the
+      // std::ofstream sink. Called with 'io_mutex_' held.
+      //
+      void preopen_next_log_file()
+      {
+         if (not options_.split_log_files or not log_output_stream_.is_open() or next_log_output_stream_.is_open()) {
+            return;
+         }
+
+         const std::chrono::seconds interval(options_.split_log_file_interval_seconds);
+         const bool half_full = log_file_bytes_ >= options_.split_log_file_at_size_bytes / 2;
+         const bool half_elapsed =
+            interval.count() > 0 and std::chrono::steady_clock::now() - log_file_opened_at_ >= interval / 2;
+         if (not half_full and not half_elapsed) return;
+
+         std::string path = log_file_sequence_.next(log_output_file_path_, default_extension);
+         if (options_.append_to_log)
+            next_log_output_stream_.open(path, std::ios_base::app);
+         else
+            next_log_output_stream_.open(path);
+         if (not next_log_output_stream_.is_open()) return; // 'split_log_file' opens it, or reports the error
+
+         if (options_.disable_file_buffering) next_log_output_stream_.rdbuf()->pubsetbuf(0, 0);
+
+         std::error_code ec;
+         const auto existing_bytes = std::filesystem::file_size(path, ec);
+         next_log_file_bytes_ = ec ? 0 : static_cast<size_t>(existing_bytes);
+         next_log_file_path_ = std::move(path);
+      }
+
+      // Closes the file opened ahead of a split that did not happen, removing it if nothing was
+      // written to it. Called with 'io_mutex_' held.
+      //
+      void discard_next_log_file()
+      {
+         if (not next_log_output_stream_.is_open()) return;
+         next_log_output_stream_.close();
+
+         std::error_code ec;
+         if (std::filesystem::file_size(next_log_file_path_, ec) == 0 and not ec) {
+            std::filesystem::remove(next_log_file_path_, ec);
+         }
+         next_log_file_path_.clear();
+         log_file_sequence_.forget();
+      }
+
+      // Writes the logging store synchronously. Called with the lock held.
+      //
+      void flush_impl()
+      {
+         flush_std_outputs();
+         flush_sinks();
+
+         if (not logging_store_.empty()) hand_off_store();
+
+         if (not io_handoff_.owns_lock()) io_handoff_.lock();
+         write_flush_store();
+         wait_log_file();
+         io_handoff_.unlock();
       };
 
      public:
+      // Whether messages of 'level' are compiled in (see: 'notarius_opts_t::min_level').
+      // Messages without a level are always compiled in.
+      //
+      template <log_level level>
+      static constexpr bool is_enabled = level == log_level::none or level >= Options.min_level;
+
+      // Sets the runtime threshold: messages below it are discarded before they are formatted.
+      // Messages without a level are not filtered. Levels below 'notarius_opts_t::min_level'
+      // stay compiled out whatever the threshold.
+      //
+      void set_min_level(const log_level level) { min_level_.store(level, std::memory_order_relaxed); }
+
+      log_level min_level() const { return min_level_.load(std::memory_order_relaxed); }
+
+      // The instance of 'Sink', one of the logger's 'Sinks', e.g., to read a 'ring_sink_t'.
+      //
+      template <typename Sink>
+      Sink& sink()
+      {
+         return std::get<Sink>(sinks_);
+      }
+
+      // Whether a message of 'level' would be logged; use it to skip building expensive arguments.
+      //
+      template <log_level level>
+      bool should_log() const
+      {
+         if constexpr (is_enabled<level>)
+            return level == log_level::none or level >= min_level_.load(std::memory_order_relaxed);
+         else
+            return false;
+      }
+
       auto& options() { return options_; }
 
       std::string logfile_path()
       {
          auto lock = get_shared_read_lock();
+         std::lock_guard io_lock(io_mutex_);
          return log_output_file_path_;
       }
 
@@ -774,7 +4819,9 @@ namespace slx
       {
          close();
          auto lock = get_exclusive_write_lock();
+         std::lock_guard io_lock(io_mutex_);
          log_output_file_path_ = get_log_file_path(path);
+         retention_started_ = false; // queue the files the new log has left too
          return log_output_file_path_;
       }
 
@@ -784,10 +4831,13 @@ namespace slx
             log_output_file_path_ = get_log_file_path(std::string(LogFileNameOrPath));
          }
          auto lock = get_shared_read_lock();
+         std::lock_guard io_lock(io_mutex_);
          return get_filename(log_output_file_path_);
       }
 
-      std::string default_extension = ".log"; // a default extension when a user does not use one
+      // a default extension when a user does not use one
+      std::string default_extension =
+         std::string(Options.binary_format ? ".nlog" : ".log") + (Options.compress_log_files ? ".lz4" : "");
 
       std::streambuf* rdbuf()
       {
@@ -838,7 +4888,52 @@ namespace slx
             return false;
          }
 
-         if (log_output_stream_.is_open()) return true;
+         if (log_file_is_open()) return true;
+
+#if defined(NOTARIUS_HAS_MMAP)
+         if (options_.memory_mapped_file) {
+            check_log_file_destination_path(log_output_file_path_);
+
+            if (not mapped_file_.open(log_output_file_path_, options_.append_to_log,
+                                      options_.split_log_file_at_size_bytes, preallocates_log_file())) {
+               const std::error_code ec(errno, std::generic_category());
+               throw std::system_error(ec, std::format("Error opening log file '{}' (error code: {})!",
+                                                       log_output_file_path_, ec.message()));
+            }
+
+            log_file_bytes_ = mapped_file_.size();
+            return true;
+         }
+#endif
+#if defined(NOTARIUS_HAS_IO_URING)
+         if (options_.io_uring_file) {
+            check_log_file_destination_path(log_output_file_path_);
+
+            if (not uring_file_.open(log_output_file_path_, options_.append_to_log, options_.io_uring_queue_depth)) {
+               const std::error_code ec(errno, std::generic_category());
+               throw std::system_error(
+                  ec, std::format("Error opening log file '{}' (error code: {})!", log_output_file_path_, ec.message()));
+            }
+
+            log_file_bytes_ = uring_file_.size();
+            preallocate_log_file();
+            return true;
+         }
+#endif
+#if defined(NOTARIUS_HAS_O_DIRECT)
+         if (options_.direct_io_file) {
+            check_log_file_destination_path(log_output_file_path_);
+
+            if (not direct_file_.open(log_output_file_path_, options_.append_to_log)) {
+               const std::error_code ec(errno, std::generic_category());
+               throw std::system_error(
+                  ec, std::format("Error opening log file '{}' (error code: {})!", log_output_file_path_, ec.message()));
+            }
+
+            log_file_bytes_ = direct_file_.size();
+            return true;
+         }
+#endif
 
          if (not log_output_stream_.is_open()) {
             check_log_file_destination_path(log_output_file_path_);
@@ -847,6 +4942,11 @@ namespace slx
                log_output_stream_.open(log_output_file_path_, std::ios_base::app);
             else
                log_output_stream_.open(log_output_file_path_);
+
+            std::error_code ec;
+            const auto existing_bytes = std::filesystem::file_size(log_output_file_path_, ec);
+            log_file_bytes_ = ec ? 0 : static_cast<size_t>(existing_bytes);
+            if (log_output_stream_.is_open()) preallocate_log_file();
          }
 
          if (not log_output_stream_.is_open()) {
@@ -870,58 +4970,102 @@ namespace slx
          return log_output_stream_.is_open();
       }
 
-      [[nodiscard]] bool is_open() const { return log_output_stream_.is_open(); }
+      [[nodiscard]] bool is_open() const { return log_file_is_open(); }
 
       // See: https://www.open-std.org/jtc1/sc22/wg21/docs/papers/2022/p2508r1.html
       //
       template <log_level level = log_level::none, is_loggable... Args>
       void print(std::format_string<Args...> fmt, Args&&... args)
       {
-         std::unique_lock<std::shared_mutex> cs(*mutex_, std::defer_lock);
+         if constexpr (is_enabled<level>) {
+            if (level != log_level::none and level < min_level_.load(std::memory_order_relaxed)) return;
 
-         if (not options_.lock_free_enabled) {
-            cs.lock();
-         }
+            static thread_local std::string msg;
 
-         static thread_local std::string msg;
+            if (options_.count_format_uses) {
+               detail::format_table_t::instance().entry(detail::format_id(fmt.get())).uses.fetch_add(
+                  1, std::memory_order_relaxed);
+            }
 
-         if (reserve_once) {
-            reserve_once = false;
-            reserve_store_capacities();
-         }
+            if constexpr ((nlog::is_encodable<Args> && ...)) {
+               if (options_.binary_format) {
+                  const detail::binary_record_t record{detail::format_id(fmt.get()), timestamp(),
+                                                       detail::this_thread_number()};
+                  msg.assign(reinterpret_cast<const char*>(&record), sizeof(record));
+                  (nlog::encode_argument(msg, args), ...);
+
+                  const bool immediate = toggle_immediate_mode_.exchange(false);
+
+                  if (options_.per_thread_buffers or options_.async_mode) {
+                     const detail::record_header_t header{.level = level, .immediate = immediate, .binary = true};
+                     if (options_.per_thread_buffers)
+                        stage(msg, header);
+                     else
+                        enqueue(msg, header);
+                     return;
+                  }
+
+                  std::unique_lock<std::shared_mutex> cs(*mutex_);
+
+                  if (writes_text()) {
+                     static thread_local std::string text;
+                     text.clear();
+                     format_message<level>(text, fmt, std::forward<Args>(args)...);
+                     write_to_outputs(text, level, immediate);
+                     if (forwarding_.load(std::memory_order_relaxed)) forward(text);
+                  }
+
+                  store_binary(msg, level);
+
+                  write_handed_off_store(cs);
+                  return;
+               }
+            }
 
-         if constexpr (log_level::none == level) msg = std::format(fmt, std::forward<Args>(args)...);
-         // msg = std::vformat(fmt.get(), std::make_format_args(args...));
-         else {
-            msg = std::format("{}: {}", to_string(level), std::format(fmt, std::forward<Args>(args)...));
-            // auto inner_formatted = std::vformat(fmt.get(), std::make_format_args(std::forward<Args>(args)...));
-            // msg = std::format("{}: {}", to_string(level), inner_formatted);
-         }
+            if (options_.per_thread_buffers or options_.async_mode) {
+               detail::record_header_t header{.level = level, .immediate = toggle_immediate_mode_.exchange(false)};
 
-         if (options_.append_newline_when_missing) {
-            if (not msg.empty() and '\n' != msg.back()) {
-               msg.append("\n");
+               if constexpr ((detail::is_deferrable<Args> && ...)) {
+                  header.deferred = options_.deferred_format;
+               }
+
+               if (header.deferred) {
+                  if constexpr ((detail::is_deferrable<Args> && ...))
+                     detail::encode_deferred<Args...>(msg, detail::format_id(fmt.get()), timestamp(), args...);
+               }
+               else {
+                  msg.clear();
+                  format_message<level>(msg, fmt, std::forward<Args>(args)...);
+               }
+
+               if (options_.per_thread_buffers)
+                  stage(msg, header);
+               else
+                  enqueue(msg, header);
+               return;
             }
-         }
 
-         write_to_std_output_stores(msg, level);
+            if (options_.lock_free_enabled and not options_.binary_format) {
+               msg.clear();
+               format_message<level>(msg, fmt, std::forward<Args>(args)...);
 
-         if (forward_to) forward_to(msg);
+               if (has_sinks or options_.enable_stdout or options_.enable_stderr or options_.enable_stdlog) {
+                  auto lock = get_exclusive_write_lock();
+                  write_to_outputs(msg, level, toggle_immediate_mode_.exchange(false));
+               }
 
-         const size_t check_size = logging_store_.size() + msg.size();
+               if (forwarding_.load(std::memory_order_relaxed)) forward(msg);
 
-         if (options_.split_log_files and (check_size >= options_.split_log_file_at_size_bytes)) {
-            flush_impl();
-            if (options_.enable_file_logging) {
-               log_output_stream_.close();
-               log_output_file_path_ = get_next_available_filename(log_output_file_path_, default_extension);
+               append_lock_free(msg);
+               return;
             }
-         }
-         else if (logging_store_.size() >= options_.flush_to_log_at_bytes) {
-            flush_impl();
-         }
 
-         logging_store_.append(std::move(msg));
+            std::unique_lock<std::shared_mutex> cs(*mutex_);
+
+            format_and_commit<level>(toggle_immediate_mode_.exchange(false), fmt, std::forward<Args>(args)...);
+
+            write_handed_off_store(cs);
+         }
       }
 
       template <log_level level = log_level::none, is_loggable T>
@@ -1023,7 +5167,7 @@ namespace slx
       template <log_level level = log_level::none, is_loggable... Args>
       auto write(std::format_string<Args...> fmt, Args&&... args)
       {
-         toggle_immediate_mode();
+         if (should_log<level>()) toggle_immediate_mode();
          return print<level>(fmt, std::forward<Args>(args)...);
       }
 
@@ -1110,7 +5254,7 @@ namespace slx
       }
 
       template <log_level level = log_level::none, is_loggable... Args>
-      friend auto& operator<<(notarius_t<LogFileNameOrPath, Options>& notarius, Args&&... args)
+      friend auto& operator<<(notarius_t& notarius, Args&&... args)
       {
          using namespace std::literals;
          notarius.print<level>("{}"sv, std::forward<Args>(args)...);
@@ -1119,8 +5263,13 @@ namespace slx
 
       void flush()
       {
+         drain_async_queue();
+         drain_forward_queue();
          auto lock = try_exclusive_write_lock();
-         if (not lock or logging_store_.empty()) return;
+         if (not lock) return;
+         seal_active_segment();
+         drain_segments();
+         if (logging_store_.empty()) return;
          flush_impl();
       }
 
@@ -1137,11 +5286,38 @@ namespace slx
 
       void toggle_immediate_mode() { toggle_immediate_mode_ = true; }
 
+      // The number of messages dropped so far by 'async_overflow_policy'.
+      //
+      uint64_t dropped_messages() const { return dropped_messages_.load(); }
+
+      // Sets a delegate to forward log messages to (e.g., to send them to custom locations).
+      // The delegate runs on a thread owned by the logger and is passed the messages in the
+      // order they were logged, in batches of up to 'forward_batch_size' messages. It must not
+      // log to this logger: a thread logging may hold the logger's lock while it waits for room
+      // in the forwarding queue. Nor may it call 'forward_to', which would deadlock on the
+      // delegate's mutex. An empty delegate stops forwarding.
+      //
+      void forward_to(std::function<void(std::span<const std::string_view>)> delegate)
+      {
+         std::lock_guard lock(forward_to_mutex_);
+         forwarding_ = static_cast<bool>(delegate);
+         forward_to_ = std::move(delegate);
+      }
+
       void close()
       {
+         drain_async_queue();
          auto lock = get_exclusive_write_lock();
+         seal_active_segment();
+         drain_segments();
          flush_impl();
-         log_output_stream_.close();
+         {
+            std::lock_guard io_lock(io_mutex_);
+            close_log_file();
+            discard_next_log_file();
+         }
+         lock.unlock();
+         drain_retire_queue();
       }
 
       void remove_log_file()
@@ -1151,6 +5327,7 @@ namespace slx
          close();
 
          auto lock = get_exclusive_write_lock();
+         std::lock_guard io_lock(io_mutex_);
 
          if (fs::exists(log_output_file_path_)) {
             try {
@@ -1213,12 +5390,14 @@ namespace slx
       const std::string_view log_path()
       {
          auto lock = get_shared_read_lock();
+         std::lock_guard io_lock(io_mutex_);
          return log_output_file_path_;
       }
 
       auto& change_log_path(const std::string_view new_path)
       {
          auto lock = get_exclusive_write_lock();
+         std::lock_guard io_lock(io_mutex_);
          log_output_file_path_ = get_log_file_path(new_path);
          return log_output_file_path_;
       }
@@ -1246,7 +5425,11 @@ namespace slx
       ~notarius_t()
       {
          try {
+            stop_writer();
             close();
+            delete_segments();
+            stop_forwarder();
+            stop_retirer();
          }
          catch (...) {
             assert(false && "'~notarius_t' Unexpected Exception in notarius_t!");
@@ -1256,6 +5439,21 @@ namespace slx
 
 } // namespace slx
 
+// Logs with 'logger.print<level>(...)' when 'level' is enabled, both at compile time (see:
+// 'notarius_opts_t::min_level') and at run time (see: 'notarius_t::set_min_level'). Unlike
+// calling 'print' directly, the arguments are not even evaluated when 'level' is disabled.
+//
+// e.g., NOTARIUS_LOG(lgr, slx::log_level::info, "{} items\n", count_items());
+//
+#define NOTARIUS_LOG(logger, level, ...)                                                 \
+   do {                                                                                  \
+      if constexpr (std::remove_cvref_t<decltype(logger)>::template is_enabled<level>) { \
+         if ((logger).template should_log<level>()) {                                    \
+            (logger).template print<level>(__VA_ARGS__);                                 \
+         }                                                                               \
+      }                                                                                  \
+   } while (false)
+
 #ifdef NOTARIUS_MODULE
 export
 {
@@ -1264,6 +5462,23 @@ export
       using slx::log_level;
       using slx::notarius_opts_t;
       using slx::notarius_t;
+      using slx::overflow_policy;
+      using slx::clock_source;
+      using slx::log_pattern_t;
+      using slx::format_count_t;
+      using slx::format_counts;
+
+      namespace nlog
+      {
+         using slx::nlog::decode;
+      }
+
+      namespace lz4
+      {
+         using slx::lz4::compress;
+         using slx::lz4::decompress;
+         using slx::lz4::compress_file;
+      }
    }
 }
 #endif
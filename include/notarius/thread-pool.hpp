@@ -102,6 +102,9 @@ namespace slx
        * @param args The arguments to the function.
        * @param priority The priority of the task.
        * @return A future that will hold the result of the function.
+       *
+       * When the queue holds 'max_queue_size' tasks the oldest task is dropped to make
+       * room (see: 'dropped_tasks'); its future reports 'std::future_errc::broken_promise'.
        */
       template <class F, class... Args>
       auto enqueue(F&& f, Args&&... args, int priority = 0) -> std::future<std::invoke_result_t<F, Args...>>
@@ -119,10 +122,8 @@ namespace slx
                throw std::runtime_error("enqueue on stopped thread_pool_t");
             }
             if (tasks_.size() >= max_queue_size_) {
-               assert(false && "You should increase your thread pool size!");
                remove_oldest_task_(tasks_);
-               // std::priority_queue<Task> empty;
-               // std::swap(tasks_, empty);
+               ++dropped_tasks_;
             }
             tasks_.emplace(Task(
                [task = std::move(task)]() {
@@ -204,6 +205,12 @@ namespace slx
          return tasks_.size();
       }
 
+      /**
+       * @brief Gets the number of tasks dropped because the queue was full.
+       * @return The number of dropped tasks.
+       */
+      size_t dropped_tasks() const { return dropped_tasks_.load(); }
+
       /**
        * @brief Waits for all tasks to complete.
        */
@@ -261,5 +268,6 @@ namespace slx
       std::atomic_bool stop_requested_{false}; ///< Flag indicating if the thread pool is stopped.
       std::atomic<size_t> active_threads_{0}; ///< The number of active threads.
       size_t max_queue_size_; ///< The maximum size of the task queue.
+      std::atomic<size_t> dropped_tasks_{0}; ///< The number of tasks dropped because the queue was full.
    };
 }
\ No newline at end of file
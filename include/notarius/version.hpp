@@ -0,0 +1,42 @@
+#pragma once
+
+// CMake Generated File (see 'version.h.in')
+// ----------------------------------------------------------------------------------------
+// This file is generated by CMake. Changes to this file will be overwritten
+// To update the contents of this file edit ''./include/version.h.in'.
+// ----------------------------------------------------------------------------------------
+
+#include <format>
+#include <iostream>
+#include <string_view>
+
+namespace slx
+{
+   struct product_version_info_t
+   {
+      static constexpr std::string_view project_name = "notarius";
+      static constexpr std::string_view project_ver = "v26.10.16";
+      static constexpr std::string_view project_description = "";
+      static constexpr std::string_view project_homepage_url = "";
+      static constexpr std::string_view company_url = "https://github.com/openalgz";
+      static constexpr std::string_view project_copyright = "(c) Open Source Team Tools 2024";
+   };
+
+   inline constexpr std::string_view product_version() { return product_version_info_t::project_ver; }
+   inline constexpr std::string_view product_name() { return product_version_info_t::project_name; }
+
+   inline auto product_about()
+   {
+      using T = product_version_info_t;
+      static const auto about = std::format(R"(About: 
+        {}
+        {}
+        {}
+        {}
+        {}
+        {})",
+                                            T::project_name, T::project_ver, T::project_description,
+                                            T::project_homepage_url, T::company_url, T::project_copyright);
+      return about;
+   }
+}
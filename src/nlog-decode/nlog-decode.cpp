@@ -0,0 +1,72 @@
+// Renders binary logs (see: 'notarius_opts_t::binary_format') as the text notarius writes
+// without 'binary_format'.
+//
+// Usage: nlog-decode [-o output] input...
+//
+// The inputs are decoded in the order given (e.g., the files of a split log), to 'output'
+// or to stdout. Inputs ending in ".lz4" are decompressed first (see:
+// 'notarius_opts_t::compress_split_log_files').
+
+#include "notarius/notarius.hpp"
+
+int main(int argc, char* argv[])
+{
+   std::vector<std::string> inputs;
+   std::string output_path;
+
+   for (int i = 1; i < argc; ++i) {
+      const std::string_view arg = argv[i];
+      if (arg == "-o" and i + 1 < argc)
+         output_path = argv[++i];
+      else
+         inputs.emplace_back(arg);
+   }
+
+   if (inputs.empty()) {
+      std::cerr << "Usage: nlog-decode [-o output] input...\n";
+      return 1;
+   }
+
+   std::ofstream output_file;
+   if (not output_path.empty()) {
+      output_file.open(output_path, std::ios_base::binary);
+      if (not output_file.is_open()) {
+         std::cerr << std::format("Error opening '{}'\n", output_path);
+         return 1;
+      }
+   }
+   std::ostream& output = output_path.empty() ? std::cout : output_file;
+
+   std::string text;
+   for (const auto& input : inputs) {
+      std::ifstream file(input, std::ios_base::binary);
+      if (not file.is_open()) {
+         std::cerr << std::format("Error opening '{}'\n", input);
+         return 1;
+      }
+
+      std::string log;
+      text.clear();
+      try {
+         if (input.ends_with(".lz4")) {
+            std::ostringstream decompressed;
+            slx::lz4::decompress(file, decompressed);
+            log = std::move(decompressed).str();
+         }
+         else {
+            log.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+         }
+
+         slx::nlog::decode(log, text);
+      }
+      catch (const std::exception& e) {
+         output.write(text.data(), text.size());
+         std::cerr << std::format("'{}': {}\n", input, e.what());
+         return 1;
+      }
+
+      output.write(text.data(), text.size());
+   }
+
+   return 0;
+}
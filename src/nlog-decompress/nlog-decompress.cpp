@@ -0,0 +1,57 @@
+// Decompresses log files compressed by notarius (see: 'notarius_opts_t::compress_split_log_files'),
+// or any other LZ4 frame.
+//
+// Usage: nlog-decompress [-o output] input...
+//
+// The inputs are decompressed in the order given (e.g., the files of a split log), to 'output'
+// or to stdout.
+
+#include "notarius/notarius.hpp"
+
+int main(int argc, char* argv[])
+{
+   std::vector<std::string> inputs;
+   std::string output_path;
+
+   for (int i = 1; i < argc; ++i) {
+      const std::string_view arg = argv[i];
+      if (arg == "-o" and i + 1 < argc)
+         output_path = argv[++i];
+      else
+         inputs.emplace_back(arg);
+   }
+
+   if (inputs.empty()) {
+      std::cerr << "Usage: nlog-decompress [-o output] input...\n";
+      return 1;
+   }
+
+   std::ofstream output_file;
+   if (not output_path.empty()) {
+      output_file.open(output_path, std::ios_base::binary);
+      if (not output_file.is_open()) {
+         std::cerr << std::format("Error opening '{}'\n", output_path);
+         return 1;
+      }
+   }
+   std::ostream& output = output_path.empty() ? std::cout : output_file;
+
+   for (const auto& input : inputs) {
+      std::ifstream file(input, std::ios_base::binary);
+      if (not file.is_open()) {
+         std::cerr << std::format("Error opening '{}'\n", input);
+         return 1;
+      }
+
+      try {
+         slx::lz4::decompress(file, output);
+      }
+      catch (const std::exception& e) {
+         std::cerr << std::format("'{}': {}\n", input, e.what());
+         return 1;
+      }
+   }
+
+   output.flush();
+   return output ? 0 : 1;
+}
@@ -21,6 +21,50 @@ static constexpr bool test_notarius_operators = false;
 using namespace boost::ut;
 using namespace slx;
 
+static size_t sink_callbacks{};
+static void count_sink_callback(std::string_view, log_level) { ++sink_callbacks; }
+
+#if defined(NOTARIUS_HAS_WRITEV)
+#include <csignal>
+#include <pthread.h>
+
+// Points a file descriptor (e.g., 1 for stdout) at a file until 'release', which returns what
+// was written to it.
+//
+struct fd_capture_t final
+{
+   fd_capture_t(const int fd, std::string path) : fd_(fd), saved_(::dup(fd)), path_(std::move(path))
+   {
+      std::fflush(nullptr);
+      const int file = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+      ::dup2(file, fd_);
+      ::close(file);
+   }
+
+   ~fd_capture_t()
+   {
+      release();
+      std::filesystem::remove(path_);
+   }
+
+   std::string release()
+   {
+      if (saved_ >= 0) {
+         std::fflush(nullptr);
+         ::dup2(saved_, fd_);
+         ::close(std::exchange(saved_, -1));
+      }
+      std::ifstream file(path_, std::ios_base::binary);
+      return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+   }
+
+  private:
+   int fd_{};
+   int saved_{-1};
+   std::string path_;
+};
+#endif
+
 void run_api_tests()
 {
    auto test_cleanup = [] {
@@ -138,6 +182,955 @@ void run_api_tests()
          expect(actual == expected);
       };
 
+      "notarius_t min_level"_test = [] {
+         notarius_t<"test-log-file.md", notarius_opts_t{.enable_file_logging = true, .min_level = log_level::warn}>
+            logger;
+         remove_files({logger.logfile_name()});
+         static_assert(not decltype(logger)::is_enabled<log_level::info>);
+         static_assert(decltype(logger)::is_enabled<log_level::warn>);
+         static_assert(decltype(logger)::is_enabled<log_level::none>);
+         int evaluated{};
+         auto argument = [&] { return ++evaluated; };
+         logger.print<log_level::none>("Hello, {}", "world\n");
+         logger.info("Hello, {}", "world\n");
+         logger.warn("Hello, {}", "world\n");
+         logger.error("Hello, {}", "world\n");
+         NOTARIUS_LOG(logger, log_level::info, "{}\n", argument());
+         NOTARIUS_LOG(logger, log_level::error, "{}\n", argument());
+         expect(evaluated == 1);
+         auto actual = logger.str();
+         constexpr auto expected = "Hello, world\nwarn: Hello, world\nerror: Hello, world\nerror: 1\n";
+         expect(actual == expected);
+      };
+
+      "notarius_t set_min_level"_test = [] {
+         notarius_t<"test-log-file.md", notarius_opts_t{.enable_file_logging = true}> logger;
+         remove_files({logger.logfile_name()});
+         logger.set_min_level(log_level::error);
+         expect(logger.min_level() == log_level::error);
+         expect(not logger.should_log<log_level::warn>());
+         expect(logger.should_log<log_level::exception>());
+         int evaluated{};
+         auto argument = [&] { return ++evaluated; };
+         logger.warn("Hello, {}", "world\n");
+         logger.error("Hello, {}", "world\n");
+         NOTARIUS_LOG(logger, log_level::warn, "{}\n", argument());
+         expect(evaluated == 0);
+         logger.set_min_level(log_level::none);
+         logger.print("Hello, {}", "world\n");
+         auto actual = logger.str();
+         constexpr auto expected = "error: Hello, world\nHello, world\n";
+         expect(actual == expected);
+      };
+
+      "notarius_t set_min_level keeps messages without a level"_test = [] {
+         notarius_t<"test-log-file.md", notarius_opts_t{.enable_file_logging = true}> logger;
+         remove_files({logger.logfile_name()});
+         logger.set_min_level(log_level::warn);
+         expect(logger.should_log<log_level::none>());
+         expect(not logger.should_log<log_level::info>());
+         logger.print("unlabeled\n");
+         logger("call operator\n");
+         logger.info("dropped\n");
+         logger.warn("kept\n");
+         NOTARIUS_LOG(logger, log_level::none, "macro\n");
+         auto actual = logger.str();
+         constexpr auto expected = "unlabeled\ncall operator\nwarn: kept\nmacro\n";
+         expect(actual == expected);
+      };
+
+      "notarius_t enable_timestamps"_test = [] {
+         auto is_timestamped = [](const std::string_view line, const std::string_view msg) {
+            // yyyy-mm-dd hh:mm:ss.fff msg
+            return line.size() == 24 + msg.size() and line[4] == '-' and line[7] == '-' and line[10] == ' ' and
+                   line[13] == ':' and line[16] == ':' and line[19] == '.' and line[23] == ' ' and
+                   line.substr(0, 4) == std::format("{:%Y}", std::chrono::system_clock::now()) and
+                   line.substr(24) == msg;
+         };
+
+         notarius_t<"test-log-file.md", notarius_opts_t{.enable_file_logging = true,
+                                                        .enable_timestamps = true,
+                                                        .utc_timestamps = true,
+                                                        .timestamp_subsecond_digits = 3}>
+            logger;
+         remove_files({logger.logfile_name()});
+         logger.info("Hello, {}", "world\n");
+         expect(is_timestamped(logger.str(), "info: Hello, world\n"));
+
+         notarius_t<"test-log-file.md", notarius_opts_t{.enable_file_logging = true,
+                                                        .async_mode = true,
+                                                        .deferred_format = true,
+                                                        .enable_timestamps = true,
+                                                        .utc_timestamps = true,
+                                                        .timestamp_subsecond_digits = 3}>
+            deferred;
+         remove_files({deferred.logfile_name()});
+         deferred.warn("Hello, {}\n", 42);
+         expect(is_timestamped(deferred.str(), "warn: Hello, 42\n"));
+      };
+
+      "notarius_t timestamp_clock"_test = [] {
+         using namespace std::chrono;
+         for (const auto clock :
+              {clock_source::system, clock_source::steady, clock_source::realtime_coarse, clock_source::tsc}) {
+            const auto ticks = detail::clock_ticks(clock);
+            const auto expected = duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+            const auto actual = detail::ticks_to_epoch_ns(clock, ticks);
+            expect(std::abs(actual - expected) < duration_cast<nanoseconds>(50ms).count());
+         }
+      };
+
+      "notarius_t pattern"_test = [] {
+         notarius_t<"test-log-file.md", notarius_opts_t{.enable_file_logging = true,
+                                                        .utc_timestamps = true,
+                                                        .pattern = "%Y-%m-%d %H:%M:%S.%e [%l] 100%% %v"}>
+            logger;
+         remove_files({logger.logfile_name()});
+         logger.info("Hello, {}", "world\n");
+         auto actual = logger.str();
+         // yyyy-mm-dd hh:mm:ss.fff [info] 100% Hello, world
+         expect(actual.size() == 24 + std::string_view("[info] 100% Hello, world\n").size());
+         expect(actual.substr(0, 4) == std::format("{:%Y}", std::chrono::system_clock::now()));
+         expect(actual[19] == '.' and actual.substr(23) == " [info] 100% Hello, world\n");
+
+         notarius_t<"test-log-file.md", notarius_opts_t{.enable_file_logging = true,
+                                                        .async_mode = true,
+                                                        .deferred_format = true,
+                                                        .pattern = "[%t] %l: %v"}>
+            deferred;
+         remove_files({deferred.logfile_name()});
+         deferred.warn("Hello, {}\n", 42);
+         const auto thread = std::format("[{}] ", detail::this_thread_number());
+         expect(deferred.str() == thread + "warn: Hello, 42\n");
+      };
+
+      "notarius_t async_mode"_test = [] {
+         notarius_t<"test-log-file.md", notarius_opts_t{.enable_file_logging = true, .async_mode = true}> logger;
+         remove_files({logger.logfile_name()});
+         logger.print<log_level::none>("Hello, {}", "world\n");
+         logger.print<log_level::info>("Hello, {}", "world\n");
+         logger.print<log_level::warn>("Hello, {}", "world\n");
+         logger.print<log_level::error>("Hello, {}", "world\n");
+         logger.print<log_level::exception>("Hello, {}", "world\n");
+         auto actual = logger.str();
+         constexpr auto expected =
+            "Hello, world\ninfo: Hello, world\nwarn: Hello, world\nerror: Hello, world\nexception: Hello, world\n";
+         expect(actual == expected);
+      };
+
+      "notarius_t async_mode multiple threads"_test = [] {
+         notarius_t<"test-log-file.md", notarius_opts_t{.enable_file_logging = true,
+                                                        .enable_stdout = false,
+                                                        .enable_stderr = false,
+                                                        .async_mode = true,
+                                                        .async_queue_capacity_bytes = 4096}>
+            logger;
+         remove_files({logger.logfile_name()});
+         constexpr auto thread_count = 4;
+         constexpr auto lines_per_thread = 1000;
+         {
+            std::vector<std::jthread> threads;
+            for (auto t = 0; t < thread_count; ++t) {
+               threads.emplace_back([&logger, t] {
+                  for (auto i = 0; i < lines_per_thread; ++i) logger("thread {} line {}\n", t, i);
+               });
+            }
+         }
+         auto actual = logger.str();
+         expect(std::count(actual.begin(), actual.end(), '\n') == thread_count * lines_per_thread);
+      };
+
+      "notarius_t async_overflow_policy"_test = [] {
+         constexpr auto thread_count = 4;
+         constexpr auto lines_per_thread = 1000;
+         auto run = [&](auto& logger) {
+            remove_files({logger.logfile_name()});
+            {
+               std::vector<std::jthread> threads;
+               for (auto t = 0; t < thread_count; ++t) {
+                  threads.emplace_back([&logger, t] {
+                     for (auto i = 0; i < lines_per_thread; ++i) logger("thread {} line {}\n", t, i);
+                  });
+               }
+            }
+            auto actual = logger.str();
+
+            // Every message is either in the log or reported by a "N messages dropped" warning.
+            size_t lines{}, reported{};
+            std::istringstream log(actual);
+            for (std::string line; std::getline(log, line);) {
+               if (line.starts_with("thread "))
+                  ++lines;
+               else if (line.starts_with("warn: ") and line.ends_with(" messages dropped"))
+                  reported += std::stoul(line.substr(6));
+            }
+            expect(reported == logger.dropped_messages());
+            expect(lines + reported == thread_count * lines_per_thread);
+         };
+
+         notarius_t<"test-log-file.md", notarius_opts_t{.enable_file_logging = true,
+                                                        .enable_stdout = false,
+                                                        .enable_stderr = false,
+                                                        .async_mode = true,
+                                                        .async_queue_capacity_bytes = 256,
+                                                        .async_overflow_policy = overflow_policy::drop_newest}>
+            drop_newest;
+         run(drop_newest);
+
+         notarius_t<"test-log-file.md", notarius_opts_t{.enable_file_logging = true,
+                                                        .enable_stdout = false,
+                                                        .enable_stderr = false,
+                                                        .async_queue_capacity_bytes = 256,
+                                                        .async_overflow_policy = overflow_policy::drop_oldest,
+                                                        .per_thread_buffers = true}>
+            drop_oldest;
+         run(drop_oldest);
+
+         // With drop_below_level, info messages may be dropped but error messages wait for room.
+         notarius_t<"test-log-file.md", notarius_opts_t{.enable_file_logging = true,
+                                                        .enable_stdout = false,
+                                                        .enable_stderr = false,
+                                                        .async_mode = true,
+                                                        .async_queue_capacity_bytes = 256,
+                                                        .async_overflow_policy = overflow_policy::drop_below_level,
+                                                        .async_overflow_level = log_level::error}>
+            drop_below_level;
+         remove_files({drop_below_level.logfile_name()});
+         {
+            std::vector<std::jthread> threads;
+            for (auto t = 0; t < thread_count; ++t) {
+               threads.emplace_back([&drop_below_level, t] {
+                  for (auto i = 0; i < lines_per_thread; ++i) {
+                     if (i % 2)
+                        drop_below_level.error("thread {} line {}\n", t, i);
+                     else
+                        drop_below_level.info("thread {} line {}\n", t, i);
+                  }
+               });
+            }
+         }
+         auto actual = drop_below_level.str();
+
+         size_t info_lines{}, error_lines{}, reported{};
+         std::istringstream log(actual);
+         for (std::string line; std::getline(log, line);) {
+            if (line.starts_with("info: thread "))
+               ++info_lines;
+            else if (line.starts_with("error: thread "))
+               ++error_lines;
+            else if (line.starts_with("warn: ") and line.ends_with(" messages dropped"))
+               reported += std::stoul(line.substr(6));
+         }
+         expect(error_lines == thread_count * lines_per_thread / 2);
+         expect(drop_below_level.dropped_messages() > 0);
+         expect(reported == drop_below_level.dropped_messages());
+         expect(info_lines + drop_below_level.dropped_messages() == thread_count * lines_per_thread / 2);
+      };
+
+      "notarius_t deferred_format"_test = [] {
+         notarius_t<"test-log-file.md",
+                    notarius_opts_t{.enable_file_logging = true, .async_mode = true, .deferred_format = true}>
+            logger;
+         remove_files({logger.logfile_name()});
+         const std::string name = "world";
+         logger.print<log_level::info>("Hello, {}\n", name);
+         logger.print<log_level::warn>("{} {:.2f} {:>4} {}\n", 1, 2.345, "abc", true);
+         logger.print("{1} {0}\n", 'a', 2u);
+         logger.print("{}\n", std::filesystem::path("not deferred").filename().string());
+         auto actual = logger.str();
+         constexpr auto expected = "info: Hello, world\nwarn: 1 2.35  abc true\n2 a\nnot deferred\n";
+         expect(actual == expected);
+      };
+
+      "notarius_t binary_format"_test = [] {
+         auto decode = [](auto& logger) {
+            remove_files({logger.logfile_name()});
+            const std::string name = "world";
+            logger.template print<log_level::info>("Hello, {}\n", name);
+            logger.template print<log_level::warn>("{} {:.2f} {:>4} {} {:#x}\n", 1, 2.345, "abc", true, 255u);
+            logger.print("{1} {0:>{2}} {{}}\n", 'a', -2, 3);
+            logger.print("{}\n", 1.5L); // not encoded, written as text
+            logger.template print<log_level::error>("Hello, {}\n", name);
+            std::string decoded;
+            nlog::decode(logger.str(), decoded);
+            return decoded;
+         };
+         constexpr auto expected =
+            "info: Hello, world\nwarn: 1 2.35  abc true 0xff\n-2   a {}\n1.5\nerror: Hello, world\n";
+
+         notarius_t<"test-log-file.nlog", notarius_opts_t{.enable_file_logging = true,
+                                                          .enable_stdout = false,
+                                                          .enable_stderr = false,
+                                                          .binary_format = true}>
+            logger;
+         expect(decode(logger) == expected);
+
+         notarius_t<"test-log-file.nlog", notarius_opts_t{.enable_file_logging = true,
+                                                          .enable_stdout = false,
+                                                          .enable_stderr = false,
+                                                          .async_mode = true,
+                                                          .pattern = "[%l] %v",
+                                                          .binary_format = true}>
+            async;
+         std::string forwarded;
+         async.forward_to([&](std::span<const std::string_view> batch) {
+            for (const auto msg : batch) forwarded.append(msg);
+         });
+         const auto decoded = decode(async);
+         expect(decoded == forwarded);
+         expect(decoded.starts_with("[info] Hello, world\n[warn] 1 2.35  abc true 0xff\n"));
+         remove_files({async.logfile_name()});
+      };
+
+      "notarius_t count_format_uses"_test = [] {
+         notarius_t<"test-log-file.md", notarius_opts_t{.enable_file_logging = true, .count_format_uses = true}> logger;
+         remove_files({logger.logfile_name()});
+         for (auto i = 0; i < 3; ++i) logger("counted {}\n", i);
+         logger.print<log_level::info>("counted {}\n", "once");
+         logger.warn("counted {} {}\n", "once", "more");
+         auto count = [](const std::string_view fmt) {
+            for (const auto& entry : format_counts()) {
+               if (entry.format == fmt) return entry.count;
+            }
+            return uint64_t{};
+         };
+         expect(count("counted {}\n") == 4);
+         expect(count("counted {} {}\n") == 1);
+      };
+
+      "notarius_t per_thread_buffers"_test = [] {
+         notarius_t<"test-log-file.md", notarius_opts_t{.enable_file_logging = true,
+                                                        .enable_stdout = false,
+                                                        .enable_stderr = false,
+                                                        .per_thread_buffers = true}>
+            logger;
+         remove_files({logger.logfile_name()});
+         constexpr auto thread_count = 4;
+         constexpr auto lines_per_thread = 1000;
+         {
+            std::vector<std::jthread> threads;
+            for (auto t = 0; t < thread_count; ++t) {
+               threads.emplace_back([&logger, t] {
+                  for (auto i = 0; i < lines_per_thread; ++i) logger("{} {}\n", t, i);
+               });
+            }
+         }
+         logger("done\n");
+         auto actual = logger.str();
+         expect(std::count(actual.begin(), actual.end(), '\n') == thread_count * lines_per_thread + 1);
+         expect(actual.ends_with("done\n"));
+
+         // The lines of each thread must appear in the order they were logged.
+         std::array<int, thread_count> next_line{};
+         bool in_order = true;
+         std::istringstream lines(actual);
+         for (int t, i; lines >> t >> i;) {
+            in_order = in_order and (i == next_line[t]++);
+         }
+         expect(in_order);
+      };
+
+      "notarius_t lock_free_enabled"_test = [] {
+         notarius_t<"test-log-file.md", notarius_opts_t{.enable_file_logging = true,
+                                                        .lock_free_enabled = true,
+                                                        .enable_stdout = false,
+                                                        .enable_stderr = false,
+                                                        .lock_free_segment_bytes = 1024}>
+            logger;
+         remove_files({logger.logfile_name()});
+         constexpr auto thread_count = 4;
+         constexpr auto lines_per_thread = 1000;
+         {
+            std::vector<std::jthread> threads;
+            for (auto t = 0; t < thread_count; ++t) {
+               threads.emplace_back([&logger, t] {
+                  for (auto i = 0; i < lines_per_thread; ++i) logger("{} {}\n", t, i);
+               });
+            }
+         }
+         logger("{}\n", std::string(2000, '-')); // larger than a segment
+         auto actual = logger.str();
+         expect(std::count(actual.begin(), actual.end(), '\n') == thread_count * lines_per_thread + 1);
+         expect(actual.ends_with(std::string(2000, '-') + "\n"));
+
+         std::array<int, thread_count> next_line{};
+         bool in_order = true;
+         std::istringstream lines(actual);
+         for (int t, i; lines >> t >> i;) {
+            in_order = in_order and (i == next_line[t]++);
+         }
+         expect(in_order);
+      };
+
+      "notarius_t forward_to"_test = [] {
+         notarius_t<"test-log-file.md",
+                    notarius_opts_t{.enable_stdout = false, .enable_stderr = false, .forward_batch_size = 16}>
+            logger;
+         constexpr auto thread_count = 4;
+         constexpr auto lines_per_thread = 1000;
+         std::vector<std::string> forwarded;
+         bool within_batch_size = true;
+         logger.forward_to([&](std::span<const std::string_view> batch) {
+            within_batch_size = within_batch_size and not batch.empty() and batch.size() <= 16;
+            forwarded.insert(forwarded.end(), batch.begin(), batch.end());
+         });
+         {
+            std::vector<std::jthread> threads;
+            for (auto t = 0; t < thread_count; ++t) {
+               threads.emplace_back([&logger, t] {
+                  for (auto i = 0; i < lines_per_thread; ++i) logger("{} {}\n", t, i);
+               });
+            }
+         }
+         logger.flush();
+         expect(forwarded.size() == thread_count * lines_per_thread);
+         expect(within_batch_size);
+
+         std::array<int, thread_count> next_line{};
+         bool in_order = true;
+         for (const auto& line : forwarded) {
+            int t{}, i{};
+            std::istringstream(line) >> t >> i;
+            in_order = in_order and (i == next_line[t]++);
+         }
+         expect(in_order);
+      };
+
+      "notarius_t sinks"_test = [] {
+         struct error_count_sink_t
+         {
+            size_t errors{};
+            bool flushed{};
+            void write(std::string_view, const log_level level) { errors += level >= log_level::error; }
+            void flush() { flushed = true; }
+         };
+         sink_callbacks = 0;
+
+         notarius_t<"test-log-file.sinks",
+                    notarius_opts_t{.enable_stdout = false, .enable_stderr = false, .split_log_files = false},
+                    ring_sink_t<3>, error_count_sink_t,
+                    callback_sink_t<count_sink_callback>>
+            logger;
+         logger("first\n");
+         logger.print<log_level::error>("second\n");
+         logger.print<log_level::warn>("third\n");
+         logger.print<log_level::exception>("fourth\n");
+         logger.close();
+
+         expect(logger.sink<ring_sink_t<3>>().messages() ==
+                std::vector<std::string>{"error: second\n", "warn: third\n", "exception: fourth\n"});
+         expect(logger.sink<error_count_sink_t>().errors == 2);
+         expect(logger.sink<error_count_sink_t>().flushed);
+         expect(sink_callbacks == 4);
+         remove_files({logger.logfile_path()});
+      };
+
+      "notarius_t sinks with binary_format"_test = [] {
+         notarius_t<"test-log-file.nlog", notarius_opts_t{.enable_stdout = false,
+                                                          .enable_stderr = false,
+                                                          .split_log_files = false,
+                                                          .binary_format = true},
+                    ring_sink_t<2>>
+            logger;
+         logger("{} {}\n", 1, "two");
+         logger("{}\n", 3.5);
+         logger.close();
+         expect(logger.sink<ring_sink_t<2>>().messages() == std::vector<std::string>{"1 two\n", "3.5\n"});
+         remove_files({logger.logfile_path()});
+      };
+
+      "notarius_t split_log_files"_test = [] {
+         remove_files_in_directory(std::filesystem::current_path(), ".split");
+         constexpr auto split_size = 4096;
+         constexpr auto thread_count = 4;
+         constexpr auto lines_per_thread = 1000;
+         {
+            notarius_t<"test-log-file.split", notarius_opts_t{.enable_file_logging = true,
+                                                              .enable_stdout = false,
+                                                              .enable_stderr = false,
+                                                              .split_log_files = true,
+                                                              .split_log_file_at_size_bytes = split_size,
+                                                              .flush_to_log_at_bytes = 1024}>
+               logger;
+            std::vector<std::jthread> threads;
+            for (auto t = 0; t < thread_count; ++t) {
+               threads.emplace_back([&logger, t] {
+                  for (auto i = 0; i < lines_per_thread; ++i) logger("{} {}\n", t, i);
+               });
+            }
+         }
+
+         size_t file_count{}, line_count{};
+         bool within_split_size = true;
+         for (const auto& entry : std::filesystem::directory_iterator(std::filesystem::current_path())) {
+            if (entry.path().extension() != ".split") continue;
+            ++file_count;
+            within_split_size = within_split_size and entry.file_size() <= split_size;
+            std::ifstream file(entry.path());
+            line_count += std::count(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>(), '\n');
+         }
+         expect(file_count > 1);
+         expect(within_split_size);
+         expect(line_count == thread_count * lines_per_thread);
+         remove_files_in_directory(std::filesystem::current_path(), ".split");
+      };
+
+      "notarius_t split_log_files past 100 files"_test = [] {
+         remove_files_in_directory(std::filesystem::current_path(), ".rotate");
+         std::ofstream("test-log-file_7.rotate").close(); // splitting continues after the highest index in use
+         constexpr auto line_count = 5000;
+         {
+            notarius_t<"test-log-file.rotate", notarius_opts_t{.enable_file_logging = true,
+                                                               .enable_stdout = false,
+                                                               .enable_stderr = false,
+                                                               .split_log_files = true,
+                                                               .split_log_file_at_size_bytes = 256,
+                                                               .flush_to_log_at_bytes = 64}>
+               logger;
+            for (auto i = 0; i < line_count; ++i) logger("line {}\n", i);
+         }
+
+         size_t file_count{}, lines{};
+         bool none_empty = true;
+         for (const auto& entry : std::filesystem::directory_iterator(std::filesystem::current_path())) {
+            if (entry.path().extension() != ".rotate" or entry.path().filename() == "test-log-file_7.rotate") continue;
+            ++file_count;
+            none_empty = none_empty and entry.file_size() > 0; // the file opened ahead of a split is removed
+            std::ifstream file(entry.path());
+            lines += std::count(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>(), '\n');
+         }
+         expect(file_count > 100);
+         expect(none_empty);
+         expect(lines == line_count);
+         expect(not std::filesystem::exists("test-log-file_1.rotate"));
+         expect(std::filesystem::exists("test-log-file_8.rotate"));
+         remove_files_in_directory(std::filesystem::current_path(), ".rotate");
+      };
+
+      "notarius_t split_log_file_interval_seconds"_test = [] {
+         remove_files_in_directory(std::filesystem::current_path(), ".interval");
+         {
+            notarius_t<"test-log-file.interval", notarius_opts_t{.enable_file_logging = true,
+                                                                 .enable_stdout = false,
+                                                                 .enable_stderr = false,
+                                                                 .split_log_files = true,
+                                                                 .split_log_file_interval_seconds = 1}>
+               logger;
+            logger("first\n");
+            logger.flush();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+            logger("second\n");
+            logger.flush();
+            logger("third\n");
+            logger.flush();
+         }
+
+         auto read = [](const std::string& path) {
+            std::ifstream file(path);
+            return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+         };
+         expect(read("test-log-file.interval") == "first\n");
+         expect(read("test-log-file_1.interval") == "second\nthird\n");
+         expect(not std::filesystem::exists("test-log-file_2.interval"));
+         remove_files_in_directory(std::filesystem::current_path(), ".interval");
+      };
+
+      "notarius_t compress_split_log_files"_test = [] {
+         remove_files_in_directory(std::filesystem::current_path(), ".zsplit");
+         remove_files_in_directory(std::filesystem::current_path(), ".lz4");
+         std::string expected;
+         {
+            notarius_t<"test-log-file.zsplit", notarius_opts_t{.enable_file_logging = true,
+                                                               .enable_stdout = false,
+                                                               .enable_stderr = false,
+                                                               .split_log_files = true,
+                                                               .split_log_file_at_size_bytes = 4096,
+                                                               .flush_to_log_at_bytes = 1024,
+                                                               .compress_split_log_files = true}>
+               logger;
+            for (auto i = 0; i < 2000; ++i) {
+               logger("line {}\n", i);
+               expected += std::format("line {}\n", i);
+            }
+            logger.close(); // waits for the compression of the files split off
+         }
+
+         // Reads the split files in order: only the last one is left uncompressed.
+         std::string actual;
+         size_t compressed{}, uncompressed{};
+         for (size_t index = 0;; ++index) {
+            const std::string path =
+               index == 0 ? "test-log-file.zsplit" : std::format("test-log-file_{}.zsplit", index);
+            if (std::ifstream file(path + ".lz4", std::ios_base::binary); file.is_open()) {
+               std::ostringstream text;
+               lz4::decompress(file, text);
+               actual += text.str();
+               ++compressed;
+            }
+            else if (std::ifstream plain(path); plain.is_open()) {
+               actual.append(std::istreambuf_iterator<char>(plain), std::istreambuf_iterator<char>());
+               ++uncompressed;
+            }
+            else {
+               break;
+            }
+         }
+         expect(compressed > 1);
+         expect(uncompressed == 1);
+         expect(actual == expected);
+         remove_files_in_directory(std::filesystem::current_path(), ".zsplit");
+         remove_files_in_directory(std::filesystem::current_path(), ".lz4");
+      };
+
+      "notarius_t max_split_log_files"_test = [] {
+         remove_files_in_directory(std::filesystem::current_path(), ".retain");
+         for (const auto* earlier : {"test-log-file_1.retain", "test-log-file_2.retain"}) {
+            std::ofstream(earlier) << "left by an earlier run\n";
+         }
+
+         std::string active;
+         {
+            notarius_t<"test-log-file.retain", notarius_opts_t{.enable_file_logging = true,
+                                                               .enable_stdout = false,
+                                                               .enable_stderr = false,
+                                                               .split_log_files = true,
+                                                               .split_log_file_at_size_bytes = 1024,
+                                                               .flush_to_log_at_bytes = 256,
+                                                               .max_split_log_files = 3}>
+               logger;
+            for (auto i = 0; i < 2000; ++i) {
+               logger("line {}\n", i);
+            }
+            logger.close(); // waits for the retention to be enforced
+            active = logger.logfile_name();
+         }
+
+         std::vector<std::string> split_off;
+         for (const auto& entry : std::filesystem::directory_iterator(std::filesystem::current_path())) {
+            const std::string name = entry.path().filename().string();
+            if (name.ends_with(".retain") and name != active) split_off.emplace_back(name);
+         }
+         std::ranges::sort(split_off);
+         expect(split_off.size() == 3);
+         expect(not std::filesystem::exists("test-log-file.retain"));
+         expect(not std::filesystem::exists("test-log-file_1.retain"));
+         expect(not std::filesystem::exists("test-log-file_2.retain"));
+         expect(std::filesystem::exists(active));
+         remove_files_in_directory(std::filesystem::current_path(), ".retain");
+      };
+
+      "notarius_t max_split_log_files_bytes"_test = [] {
+         remove_files_in_directory(std::filesystem::current_path(), ".retain");
+         std::string active;
+         {
+            notarius_t<"test-log-file.retain", notarius_opts_t{.enable_file_logging = true,
+                                                               .enable_stdout = false,
+                                                               .enable_stderr = false,
+                                                               .split_log_files = true,
+                                                               .split_log_file_at_size_bytes = 1024,
+                                                               .flush_to_log_at_bytes = 256,
+                                                               .max_split_log_files_bytes = 4096}>
+               logger;
+            for (auto i = 0; i < 2000; ++i) {
+               logger("line {}\n", i);
+            }
+            logger.close();
+            active = logger.logfile_name();
+         }
+
+         size_t files{}, bytes{};
+         for (const auto& entry : std::filesystem::directory_iterator(std::filesystem::current_path())) {
+            const std::string name = entry.path().filename().string();
+            if (not name.ends_with(".retain") or name == active) continue;
+            ++files;
+            bytes += std::filesystem::file_size(entry.path());
+         }
+         expect(files > 1);
+         expect(bytes <= 4096);
+         expect(bytes > 4096 - 1024);
+         remove_files_in_directory(std::filesystem::current_path(), ".retain");
+      };
+
+      "notarius_t compress_log_files"_test = [] {
+         notarius_t<"test-log-file.log.lz4", notarius_opts_t{.enable_file_logging = true,
+                                                             .enable_stdout = false,
+                                                             .enable_stderr = false,
+                                                             .split_log_files = false,
+                                                             .flush_to_log_at_bytes = 4096,
+                                                             .compress_log_files = true}>
+            logger;
+         remove_files({logger.logfile_name()});
+         std::string expected;
+         for (auto i = 0; i < 5000; ++i) {
+            logger("line {} of the compressed log\n", i);
+            expected += std::format("line {} of the compressed log\n", i);
+         }
+         logger.close();
+
+         const auto path = logger.logfile_path();
+         const auto compressed_size = std::filesystem::file_size(path);
+         expect(compressed_size * 4 < expected.size());
+
+         auto decompress = [&] {
+            std::ifstream file(path, std::ios_base::binary);
+            std::ostringstream text;
+            try {
+               lz4::decompress(file, text);
+            }
+            catch (const std::runtime_error&) {
+            }
+            return text.str();
+         };
+         expect(decompress() == expected);
+
+         // A log cut off in its last frame still decompresses up to that frame.
+         std::filesystem::resize_file(path, compressed_size - 10);
+         const auto partial = decompress();
+         expect(partial.size() > expected.size() / 2);
+         expect(expected.starts_with(partial));
+         remove_files({path});
+      };
+
+#if defined(NOTARIUS_HAS_WRITEV)
+      "write_gathered resumes after short writes"_test = [] {
+         // A blocking write to a pipe interrupted by a signal returns the bytes written so far.
+         struct sigaction action{};
+         action.sa_handler = [](int) {}; // no SA_RESTART
+         struct sigaction previous{};
+         ::sigaction(SIGUSR1, &action, &previous);
+
+         std::array<int, 2> pipe_fds{};
+         expect(::pipe(pipe_fds.data()) == 0);
+
+         std::string first, second;
+         for (auto i = 0; i < 40'000; ++i) {
+            first += std::format("{:07}\n", i);
+            second += std::format("{:07}\n", -i);
+         }
+
+         std::string received;
+         std::jthread reader([&] {
+            std::array<char, 4096> buffer;
+            for (ssize_t n; (n = ::read(pipe_fds[0], buffer.data(), buffer.size())) != 0;) {
+               if (n < 0) break;
+               received.append(buffer.data(), static_cast<size_t>(n));
+               std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+         });
+
+         std::atomic_bool written{};
+         std::jthread interrupter([&written, writer = ::pthread_self()] {
+            while (not written) {
+               ::pthread_kill(writer, SIGUSR1);
+               std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+         });
+
+         const bool result = detail::write_gathered<3>(pipe_fds[1], {first, std::string_view{}, second});
+         written = true;
+         interrupter.join();
+         ::close(pipe_fds[1]);
+         reader.join();
+         ::close(pipe_fds[0]);
+         ::sigaction(SIGUSR1, &previous, nullptr);
+
+         expect(result);
+         expect(received == first + second);
+      };
+
+      "notarius_t flush_std_outputs with writev"_test = [] {
+         std::string out, err;
+         {
+            notarius_t<"test-log-file.stdio", notarius_opts_t{.enable_file_logging = true,
+                                                              .immediate_mode = false,
+                                                              .enable_stdout = true,
+                                                              .enable_stderr = true,
+                                                              .enable_stdlog = true,
+                                                              .split_log_files = false,
+                                                              .flush_to_std_outputs_at_bytes = 1 << 20}>
+               logger;
+            fd_capture_t stdout_capture(1, "test-stdout.txt");
+            fd_capture_t stderr_capture(2, "test-stderr.txt");
+
+            std::cout << "written before\n"; // left in the stream's buffer, or stdout's
+            logger("plain\n");
+            logger.info("info\n");
+            logger.error("error\n");
+            logger.flush();
+
+            out = stdout_capture.release();
+            err = stderr_capture.release();
+            logger.close();
+            remove_files({logger.logfile_path()});
+         }
+
+         expect(out == "written before\nplain\ninfo: info\n");
+         // One writev(2) for stderr: 'cerr_store_', then 'clog_store_'.
+         expect(err == "error: error\nplain\ninfo: info\nerror: error\n");
+      };
+
+      "notarius_t flush_std_outputs after std_stream_redirection_t"_test = [] {
+         std::string out, err;
+         std::ostringstream redirected_cerr;
+         {
+            notarius_t<"test-log-file.stdio", notarius_opts_t{.enable_file_logging = true,
+                                                              .immediate_mode = false,
+                                                              .enable_stdout = true,
+                                                              .enable_stderr = true,
+                                                              .enable_stdlog = true,
+                                                              .split_log_files = false,
+                                                              .flush_to_std_outputs_at_bytes = 1 << 20}>
+               logger;
+            fd_capture_t stdout_capture(1, "test-stdout.txt");
+            fd_capture_t stderr_capture(2, "test-stderr.txt");
+            {
+               // With a stream redirected, the stores are written through the streams.
+               std_stream_redirection_t redirection(std::cerr, redirected_cerr.rdbuf());
+               logger("plain\n");
+               logger.error("error\n");
+               logger.flush();
+            }
+
+            out = stdout_capture.release();
+            err = stderr_capture.release();
+            logger.close();
+            remove_files({logger.logfile_path()});
+         }
+
+         expect(out == "plain\n");
+         expect(redirected_cerr.str() == "error: error\n");
+         expect(err == "plain\nerror: error\n"); // std::clog, not redirected
+      };
+#endif
+
+#if defined(NOTARIUS_HAS_FALLOCATE)
+      "notarius_t preallocate_log_files"_test = [] {
+         remove_files_in_directory(std::filesystem::current_path(), ".prealloc");
+         constexpr auto split_size = 65536;
+         auto allocated_bytes = [](const std::filesystem::path& path) {
+            struct stat st{};
+            ::stat(path.c_str(), &st);
+            return static_cast<size_t>(st.st_blocks) * 512;
+         };
+
+         size_t line_count{};
+         {
+            notarius_t<"test-log-file.prealloc", notarius_opts_t{.enable_file_logging = true,
+                                                                 .enable_stdout = false,
+                                                                 .enable_stderr = false,
+                                                                 .split_log_files = true,
+                                                                 .split_log_file_at_size_bytes = split_size,
+                                                                 .flush_to_log_at_bytes = 1024,
+                                                                 .preallocate_log_files = true}>
+               logger;
+            logger("first\n");
+            logger.flush();
+            expect(allocated_bytes(logger.logfile_path()) >= split_size);
+            expect(std::filesystem::file_size(logger.logfile_path()) == 6);
+
+            for (auto i = 0; i < 20000; ++i) logger("line {}\n", i);
+         }
+
+         size_t file_count{};
+         bool trimmed = true;
+         for (const auto& entry : std::filesystem::directory_iterator(std::filesystem::current_path())) {
+            if (entry.path().extension() != ".prealloc") continue;
+            ++file_count;
+            trimmed = trimmed and allocated_bytes(entry.path()) <= entry.file_size() + 16384;
+            std::ifstream file(entry.path());
+            line_count += std::count(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>(), '\n');
+         }
+         expect(file_count > 1);
+         expect(trimmed);
+         expect(line_count == 20001);
+         remove_files_in_directory(std::filesystem::current_path(), ".prealloc");
+      };
+#endif
+
+      "notarius_t memory_mapped_file"_test = [] {
+         notarius_t<"test-log-file.md", notarius_opts_t{.enable_file_logging = true,
+                                                        .enable_stdout = false,
+                                                        .enable_stderr = false,
+                                                        .split_log_files = false,
+                                                        .split_log_file_at_size_bytes = 4096,
+                                                        .flush_to_log_at_bytes = 1000,
+                                                        .memory_mapped_file = true}>
+            logger;
+         remove_files({logger.logfile_name()});
+         std::string expected;
+         for (auto i = 0; i < 1000; ++i) {
+            logger("line {}\n", i);
+            expected += std::format("line {}\n", i);
+         }
+         expect(logger.str() == expected); // larger than a segment, truncated on close
+         expect(std::filesystem::file_size(logger.logfile_name()) == expected.size());
+
+         logger("appended\n");
+         expect(logger.str() == expected + "appended\n");
+      };
+
+      "notarius_t io_uring_file"_test = [] {
+         notarius_t<"test-log-file.md", notarius_opts_t{.enable_file_logging = true,
+                                                        .enable_stdout = false,
+                                                        .enable_stderr = false,
+                                                        .split_log_files = false,
+                                                        .flush_to_log_at_bytes = 1000,
+                                                        .io_uring_file = true,
+                                                        .io_uring_queue_depth = 2}>
+            logger;
+         remove_files({logger.logfile_name()});
+         constexpr auto thread_count = 4;
+         constexpr auto lines_per_thread = 1000;
+         {
+            std::vector<std::jthread> threads;
+            for (auto t = 0; t < thread_count; ++t) {
+               threads.emplace_back([&logger, t] {
+                  for (auto i = 0; i < lines_per_thread; ++i) logger("{} {}\n", t, i);
+               });
+            }
+         }
+         logger.flush();
+         expect(std::filesystem::file_size(logger.logfile_name()) == logger.str().size());
+
+         auto actual = logger.str();
+         expect(std::count(actual.begin(), actual.end(), '\n') == thread_count * lines_per_thread);
+
+         std::array<int, thread_count> next_line{};
+         bool in_order = true;
+         std::istringstream lines(actual);
+         for (int t, i; lines >> t >> i;) {
+            in_order = in_order and (i == next_line[t]++);
+         }
+         expect(in_order);
+      };
+
+      "notarius_t direct_io_file"_test = [] {
+         notarius_t<"test-log-file.md", notarius_opts_t{.enable_file_logging = true,
+                                                        .enable_stdout = false,
+                                                        .enable_stderr = false,
+                                                        .split_log_files = false,
+                                                        .flush_to_log_at_bytes = 1000,
+                                                        .direct_io_file = true}>
+            logger;
+         remove_files({logger.logfile_name()});
+         expect(logger.options().flush_to_log_at_bytes == 4096);
+
+         std::string expected;
+         for (auto i = 0; i < 1000; ++i) {
+            logger("line {}\n", i);
+            expected += std::format("line {}\n", i);
+            if (i % 100 == 0) logger.flush(); // leaves a partial block to be completed by the next write
+         }
+         logger.flush();
+         expect(std::filesystem::file_size(logger.logfile_name()) == expected.size());
+         expect(logger.str() == expected);
+
+         logger.close();
+         logger.options().append_to_log = true;
+         logger("appended\n");
+         expect(logger.str() == expected + "appended\n");
+      };
+
       "notarius_t operator() method"_test = [] {
          notarius_t<"test-log-file.md", notarius_opts_t{}> logger;
          logger.enable_file_logging();